@@ -0,0 +1,131 @@
+// Floods SDLInput with synthetic events and times Update and the query functions.
+// Runs on SDL's dummy video driver, so it needs no window or display.
+//
+// Build it with SDLInput.cpp, SDLWindow.cpp, SDLRecording.cpp, SDLActions.cpp, SDLContext.cpp,
+// SDLTexture.cpp, SDLArchive.cpp and SDLMappedFile.cpp, and link SDL2 and SDL_image.
+// Usage: InputBenchmark [iterations] [events per burst] [queries per iteration]
+
+#include "../SDLInput.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Timing helpers
+static Uint64 Now()
+{
+   return SDL_GetPerformanceCounter();
+}
+
+static double Nanoseconds(Uint64 ticks)
+{
+   return ticks * 1000000000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Cheap repeatable random numbers so runs compare
+static Uint32 randomState = 12345;
+static Uint32 Random()
+{
+   randomState = randomState * 1664525u + 1013904223u;
+   return randomState >> 8;
+}
+
+// Pushes a burst of keyboard, mouse motion and mouse button events
+static void PushBurst(const int count)
+{
+   SDL_Event event;
+   for (int ii = 0; ii < count; ++ii) {
+      SDL_memset(&event, 0, sizeof(event));
+      Uint32 kind = Random() % 8;
+
+      // Mostly motion, like a high polling rate mouse
+      if (kind < 5) {
+         event.type = SDL_MOUSEMOTION;
+         event.motion.x = (Sint32)(Random() % 1920);
+         event.motion.y = (Sint32)(Random() % 1080);
+         event.motion.xrel = (Sint32)(Random() % 5) - 2;
+         event.motion.yrel = (Sint32)(Random() % 5) - 2;
+      }
+      else if (kind < 7) {
+         SDL_Scancode scancode = (SDL_Scancode)(SDL_SCANCODE_A + Random() % 26);
+         event.type = (Random() & 1 ? SDL_KEYDOWN : SDL_KEYUP);
+         event.key.state = (event.type == SDL_KEYDOWN ? SDL_PRESSED : SDL_RELEASED);
+         event.key.keysym.scancode = scancode;
+         event.key.keysym.sym = SDL_GetKeyFromScancode(scancode);
+      }
+      else {
+         event.type = (Random() & 1 ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP);
+         event.button.button = (Uint8)(1 + Random() % 3);
+         event.button.state = (event.type == SDL_MOUSEBUTTONDOWN ? SDL_PRESSED : SDL_RELEASED);
+         event.button.clicks = 1;
+      }
+      SDL_PushEvent(&event);
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   int iterations = (argc > 1 ? atoi(argv[1]) : 200);
+   int burst = (argc > 2 ? atoi(argv[2]) : 2000);
+   int queries = (argc > 3 ? atoi(argv[3]) : 100000);
+
+   // SDL's queue holds 65535 events
+   if (burst > 60000) {
+      burst = 60000;
+   }
+
+   // No display needed
+   SDL_SetHint(SDL_HINT_VIDEODRIVER, "dummy");
+   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
+      printf("SDL_Init failed: %s\n", SDL_GetError());
+      return 1;
+   }
+   SDLInput::Instance()->Init();
+
+   // Keys to ask about
+   SDL_Keycode keys[26];
+   for (int ii = 0; ii < 26; ++ii) {
+      keys[ii] = SDLK_a + ii;
+   }
+
+   Uint64 updateTicks = 0;
+   Uint64 queryTicks = 0;
+   long long events = 0;
+   long long queryCount = 0;
+   int hits = 0;
+
+   for (int ii = 0; ii < iterations; ++ii) {
+      PushBurst(burst);
+
+      // Update with the whole burst waiting
+      Uint64 start = Now();
+      SDLInput::Instance()->Update();
+      updateTicks += Now() - start;
+      events += SDLInput::Instance()->EventCount();
+
+      // Mix of the usual questions
+      const SDLInput* controls = SDLInput::Instance();
+      start = Now();
+      for (int jj = 0; jj < queries; jj += 4) {
+         hits += controls->KeyDown(keys[jj % 26]);
+         hits += controls->KeyPressed(keys[(jj + 7) % 26]);
+         hits += controls->ButtonPressed(1 + jj % 3);
+         hits += controls->AnyKeyPressed();
+      }
+      queryTicks += Now() - start;
+      queryCount += (queries + 3) / 4 * 4;
+   }
+
+   printf("SDLInput flood benchmark\n");
+   printf("  iterations:       %d\n", iterations);
+   printf("  events per burst: %d\n", burst);
+   printf("  events handled:   %lld\n", events);
+   printf("  Update:           %.1f ns/event (%.3f ms per burst)\n",
+      (events > 0 ? Nanoseconds(updateTicks) / events : 0.0), Nanoseconds(updateTicks) / iterations / 1000000.0);
+   printf("  queries:          %.2f ns/query (%lld queries)\n",
+      (queryCount > 0 ? Nanoseconds(queryTicks) / queryCount : 0.0), queryCount);
+   printf("  (checksum %d)\n", hits);
+
+   SDLInput::Instance()->Shutdown();
+   SDL_Quit();
+   return 0;
+}
@@ -0,0 +1,237 @@
+#include "SDLActions.h"
+#include "SDLInput.h"
+#include <cassert>
+#include <cstring>
+
+// Modifier groups, either side of a group satisfies a binding
+static const Uint16 modGroups[4] = {
+   KMOD_LSHIFT | KMOD_RSHIFT,
+   KMOD_LCTRL | KMOD_RCTRL,
+   KMOD_LALT | KMOD_RALT,
+   KMOD_LGUI | KMOD_RGUI
+};
+
+// Returns true if every modifier group the binding wants is held
+static bool ModsHeld(const Uint16 wanted, const Uint16 held)
+{
+   for (int ii = 0; ii < 4; ++ii) {
+      if ((wanted & modGroups[ii]) && !(held & modGroups[ii])) {
+         return false;
+      }
+   }
+   return true;
+}
+
+// Constructor
+InputActions::InputActions()
+{
+   compiled = true;
+}
+
+// Adds a binding
+void InputActions::Add(const BindingType type, const int action, const SDL_Keycode* keys, const int keyCount,
+   const Uint16 mods, const int button, const Uint32 maxGap)
+{
+   assert(action > -1 && action < MAXACTIONS && "Invalid action when binding");
+
+   Binding binding;
+   memset(&binding, 0, sizeof(binding));
+   binding.type = type;
+   binding.action = action;
+   binding.keyCount = keyCount;
+   for (int ii = 0; ii < keyCount; ++ii) {
+      binding.keys[ii] = keys[ii];
+   }
+   binding.mods = mods;
+   binding.button = button;
+   binding.maxGap = maxGap;
+   bindings.push_back(binding);
+
+   compiled = false;
+}
+
+// Action is down while the key is
+void InputActions::BindKey(const int action, const SDL_Keycode key, const Uint16 mods)
+{
+   Add(BIND_KEY, action, &key, 1, mods, 0, 0);
+}
+
+// Action is down while the mouse button is
+void InputActions::BindButton(const int action, const int button)
+{
+   assert(button > -1 && button < NUMBUTTONS && "Invalid mouse button when binding");
+   Add(BIND_BUTTON, action, nullptr, 0, KMOD_NONE, button, 0);
+}
+
+// Action is down while all the keys are held together
+void InputActions::BindChord(const int action, const SDL_Keycode* keys, const int count)
+{
+   assert(count > 0 && count <= MAXCHORDKEYS && "Too many keys in a chord");
+   Add(BIND_CHORD, action, keys, count, KMOD_NONE, 0, 0);
+}
+
+// Action is down for one frame when the keys are pressed in order
+void InputActions::BindSequence(const int action, const SDL_Keycode* keys, const int count, const Uint32 maxGap)
+{
+   assert(count > 0 && count <= MAXSEQUENCEKEYS && "Too many keys in a sequence");
+   Add(BIND_SEQUENCE, action, keys, count, KMOD_NONE, 0, maxGap);
+}
+
+// Removes every binding for an action
+void InputActions::Unbind(const int action)
+{
+   for (unsigned int ii = 0; ii < bindings.size();) {
+      if (bindings[ii].action == action) {
+         bindings.erase(bindings.begin() + ii);
+      }
+      else {
+         ++ii;
+      }
+   }
+   compiled = false;
+}
+
+// Removes every binding
+void InputActions::Clear()
+{
+   bindings.clear();
+   compiled = false;
+}
+
+// Builds the flat tables from the bindings
+void InputActions::Compile()
+{
+   keyTable.clear();
+   buttonTable.clear();
+   chordTable.clear();
+   sequenceTable.clear();
+
+   for (unsigned int ii = 0; ii < bindings.size(); ++ii) {
+      const Binding& binding = bindings[ii];
+      switch (binding.type)
+      {
+         case BIND_KEY:
+         {
+            KeyEntry entry;
+            entry.scancode = (Uint16)InputState::KeyToScancode(binding.keys[0]);
+            entry.mods = binding.mods;
+            entry.action = (Uint16)binding.action;
+            keyTable.push_back(entry);
+            break;
+         }
+         case BIND_BUTTON:
+         {
+            ButtonEntry entry;
+            entry.button = (Uint8)binding.button;
+            entry.action = (Uint16)binding.action;
+            buttonTable.push_back(entry);
+            break;
+         }
+         case BIND_CHORD:
+         {
+            ChordEntry entry;
+            for (int jj = 0; jj < binding.keyCount; ++jj) {
+               entry.scancodes[jj] = (Uint16)InputState::KeyToScancode(binding.keys[jj]);
+            }
+            entry.count = binding.keyCount;
+            entry.action = (Uint16)binding.action;
+            chordTable.push_back(entry);
+            break;
+         }
+         case BIND_SEQUENCE:
+         {
+            SequenceEntry entry;
+            for (int jj = 0; jj < binding.keyCount; ++jj) {
+               entry.scancodes[jj] = (Uint16)InputState::KeyToScancode(binding.keys[jj]);
+            }
+            entry.count = binding.keyCount;
+            entry.action = (Uint16)binding.action;
+            entry.maxGap = binding.maxGap;
+            entry.progress = 0;
+            entry.lastTime = 0;
+            sequenceTable.push_back(entry);
+            break;
+         }
+      };
+   }
+
+   compiled = true;
+}
+
+// Works out which actions are down this frame
+void InputActions::Evaluate(const InputState& state, const KeyPress* presses, const int pressCount,
+   const Uint32 now, Uint64* down)
+{
+   memset(down, 0, sizeof(Uint64) * ACTIONWORDS);
+
+   if (!compiled) {
+      Compile();
+   }
+
+   // Keys (pressed counts too, a tap that went down and up within the frame still fires once)
+   Uint16 mods = state.Mods();
+   for (unsigned int ii = 0; ii < keyTable.size(); ++ii) {
+      const KeyEntry& entry = keyTable[ii];
+      SDL_Scancode scancode = (SDL_Scancode)entry.scancode;
+      if ((state.KeyDown(scancode) || state.KeyPressed(scancode)) && ModsHeld(entry.mods, mods)) {
+         down[entry.action >> 6] |= (Uint64)1 << (entry.action & 63);
+      }
+   }
+
+   // Mouse buttons
+   for (unsigned int ii = 0; ii < buttonTable.size(); ++ii) {
+      if (state.ButtonDown(buttonTable[ii].button) || state.ButtonPressed(buttonTable[ii].button)) {
+         down[buttonTable[ii].action >> 6] |= (Uint64)1 << (buttonTable[ii].action & 63);
+      }
+   }
+
+   // Chords
+   for (unsigned int ii = 0; ii < chordTable.size(); ++ii) {
+      const ChordEntry& entry = chordTable[ii];
+      bool held = true;
+      for (int jj = 0; jj < entry.count && held; ++jj) {
+         SDL_Scancode scancode = (SDL_Scancode)entry.scancodes[jj];
+         held = (state.KeyDown(scancode) || state.KeyPressed(scancode));
+      }
+      if (held) {
+         down[entry.action >> 6] |= (Uint64)1 << (entry.action & 63);
+      }
+   }
+
+   // Sequences step through the presses one at a time, in the order they happened
+   for (unsigned int ii = 0; ii < sequenceTable.size(); ++ii) {
+      SequenceEntry& entry = sequenceTable[ii];
+      for (int jj = 0; jj < pressCount; ++jj) {
+         const KeyPress& press = presses[jj];
+
+         // Took too long, start over
+         if (entry.progress > 0 && press.timestamp - entry.lastTime > entry.maxGap) {
+            entry.progress = 0;
+         }
+
+         // Next key in the sequence?
+         if (press.scancode == entry.scancodes[entry.progress]) {
+            entry.progress++;
+            entry.lastTime = press.timestamp;
+            if (entry.progress == entry.count) {
+               down[entry.action >> 6] |= (Uint64)1 << (entry.action & 63);
+               entry.progress = 0;
+            }
+         }
+         // Modifiers (held for the combo, or just resting on Shift) don't break it
+         else if (press.scancode >= SDL_SCANCODE_LCTRL && press.scancode <= SDL_SCANCODE_RGUI) {
+            continue;
+         }
+         // Wrong key, it might be the start of a new attempt though
+         else {
+            entry.progress = (press.scancode == entry.scancodes[0] ? 1 : 0);
+            entry.lastTime = press.timestamp;
+         }
+      }
+
+      // Took too long and nothing came
+      if (entry.progress > 0 && now - entry.lastTime > entry.maxGap) {
+         entry.progress = 0;
+      }
+   }
+}
@@ -0,0 +1,117 @@
+#ifndef SDLACTIONS_H_
+#define SDLACTIONS_H_
+
+// Defines
+#define MAXACTIONS 128
+#define ACTIONWORDS (MAXACTIONS / 64)
+#define MAXCHORDKEYS 4
+#define MAXSEQUENCEKEYS 8
+#define MAXFRAMEPRESSES 32
+
+// Includes
+#include <vector>
+#include <SDL_events.h>
+
+// Using statements
+using std::vector;
+
+class InputState;
+
+// A key going down (not a repeat). SDLInput keeps a frame's presses in order for the sequences,
+// which need to see two keys pressed in the same frame as two steps.
+struct KeyPress {
+   Uint16 scancode;
+   Uint32 timestamp;
+};
+
+// Maps keys, modifier combos, mouse buttons, chords and timed sequences onto
+// action numbers (0 to MAXACTIONS - 1). Bindings are compiled into flat tables
+// and every action is worked out in one pass per SDLInput::Update, so asking
+// about an action is a single bit test and rebinding never touches game code.
+class InputActions {
+private:
+   // A binding the way it was asked for
+   enum BindingType { BIND_KEY, BIND_BUTTON, BIND_CHORD, BIND_SEQUENCE };
+   struct Binding {
+      BindingType type;
+      int action;
+      SDL_Keycode keys[MAXSEQUENCEKEYS];
+      int keyCount;
+      Uint16 mods;
+      int button;
+      Uint32 maxGap;
+   };
+
+   // The compiled tables
+   struct KeyEntry {
+      Uint16 scancode;
+      Uint16 mods;
+      Uint16 action;
+   };
+   struct ButtonEntry {
+      Uint8 button;
+      Uint16 action;
+   };
+   struct ChordEntry {
+      Uint16 scancodes[MAXCHORDKEYS];
+      int count;
+      Uint16 action;
+   };
+   struct SequenceEntry {
+      Uint16 scancodes[MAXSEQUENCEKEYS];
+      int count;
+      Uint16 action;
+      Uint32 maxGap;
+      int progress;
+      Uint32 lastTime;
+   };
+
+   // Members
+   vector<Binding> bindings;
+   vector<KeyEntry> keyTable;
+   vector<ButtonEntry> buttonTable;
+   vector<ChordEntry> chordTable;
+   vector<SequenceEntry> sequenceTable;
+   bool compiled;
+
+   // Adds a binding
+   void Add(const BindingType type, const int action, const SDL_Keycode* keys, const int keyCount,
+      const Uint16 mods, const int button, const Uint32 maxGap);
+
+   // Builds the flat tables from the bindings
+   void Compile();
+
+public:
+   // Constructor
+   InputActions();
+
+   // Action is down while the key is (and the modifiers are held, either side counts)
+   void BindKey(const int action, const SDL_Keycode key, const Uint16 mods = KMOD_NONE);
+
+   // Action is down while the mouse button is
+   void BindButton(const int action, const int button);
+
+   // Action is down while all the keys are held together (up to MAXCHORDKEYS)
+   void BindChord(const int action, const SDL_Keycode* keys, const int count);
+
+   // Action is down for one frame when the keys are pressed in order, each within maxGap milliseconds
+   // of the last (up to MAXSEQUENCEKEYS)
+   void BindSequence(const int action, const SDL_Keycode* keys, const int count, const Uint32 maxGap = 500);
+
+   // Removes every binding for an action
+   void Unbind(const int action);
+
+   // Removes every binding
+   void Clear();
+
+   // Makes the tables get rebuilt (the keyboard layout changed)
+   void Invalidate() { compiled = false; }
+
+   // Works out which actions are down this frame, one bit per action. presses are the frame's key
+   // presses, oldest first. now is in SDL ticks, from the frame's events rather than the clock so
+   // replays time sequences the way the recording did.
+   void Evaluate(const InputState& state, const KeyPress* presses, const int pressCount, const Uint32 now,
+      Uint64* down);
+};
+
+#endif // SDLACTIONS_H_
@@ -0,0 +1,476 @@
+#include "SDLArchive.h"
+#include "SDLHash.h"
+#include <cstring>
+
+#ifdef SDLWRAPPERS_LZ4
+#include <lz4.h>
+#endif
+
+// Using statements
+using std::lock_guard;
+
+// File header
+static const Uint8 archiveMagic[4] = { 'S', 'D', 'L', 'A' };
+static const Uint32 archiveVersion = 1;
+static const Uint32 archiveHeaderSize = 16;
+static const Uint32 archiveEntrySize = 32;
+
+// Entry flags
+static const Uint16 entryLZ4 = 1;
+
+// What a stream over archived bytes keeps (owned is set when the bytes were decompressed)
+struct ArchiveStream {
+   const Uint8* data;
+   Sint64 size;
+   Sint64 position;
+   Uint8* owned;
+};
+
+// Reads little endian values out of the mapping
+static Uint16 Read16(const Uint8* data)
+{
+   Uint16 value;
+   memcpy(&value, data, sizeof(value));
+   return SDL_SwapLE16(value);
+}
+static Uint32 Read32(const Uint8* data)
+{
+   Uint32 value;
+   memcpy(&value, data, sizeof(value));
+   return SDL_SwapLE32(value);
+}
+static Uint64 Read64(const Uint8* data)
+{
+   Uint64 value;
+   memcpy(&value, data, sizeof(value));
+   return SDL_SwapLE64(value);
+}
+
+// Names are stored with forward slashes and no leading "./"
+static string ArchiveKey(const char* fileName)
+{
+   string key = fileName;
+   for (unsigned int ii = 0; ii < key.size(); ++ii) {
+      if (key[ii] == '\\') {
+         key[ii] = '/';
+      }
+   }
+   while (key.compare(0, 2, "./") == 0) {
+      key.erase(0, 2);
+   }
+   return key;
+}
+
+// Hashes a name for the table of contents
+static Uint64 NameHash(const string& key)
+{
+   return HashBytes(key.c_str(), key.size());
+}
+
+// Stream functions
+static Sint64 SDLCALL StreamSize(SDL_RWops* context)
+{
+   return ((ArchiveStream*)context->hidden.unknown.data1)->size;
+}
+
+static Sint64 SDLCALL StreamSeek(SDL_RWops* context, Sint64 offset, int whence)
+{
+   ArchiveStream* stream = (ArchiveStream*)context->hidden.unknown.data1;
+   Sint64 position = offset;
+   if (whence == RW_SEEK_CUR) {
+      position += stream->position;
+   }
+   else if (whence == RW_SEEK_END) {
+      position += stream->size;
+   }
+   else if (whence != RW_SEEK_SET) {
+      return SDL_SetError("Unknown seek in archive stream");
+   }
+   if (position < 0) {
+      position = 0;
+   }
+   if (position > stream->size) {
+      position = stream->size;
+   }
+   stream->position = position;
+   return position;
+}
+
+static size_t SDLCALL StreamRead(SDL_RWops* context, void* ptr, size_t size, size_t maxnum)
+{
+   ArchiveStream* stream = (ArchiveStream*)context->hidden.unknown.data1;
+   if (size == 0) {
+      return 0;
+   }
+   size_t available = (size_t)(stream->size - stream->position) / size;
+   size_t count = (maxnum < available ? maxnum : available);
+   memcpy(ptr, stream->data + stream->position, count * size);
+   stream->position += (Sint64)(count * size);
+   return count;
+}
+
+static size_t SDLCALL StreamWrite(SDL_RWops* context, const void* ptr, size_t size, size_t num)
+{
+   SDL_SetError("Archive streams are read only");
+   return 0;
+}
+
+static int SDLCALL StreamClose(SDL_RWops* context)
+{
+   ArchiveStream* stream = (ArchiveStream*)context->hidden.unknown.data1;
+   SDL_free(stream->owned);
+   SDL_free(stream);
+   SDL_FreeRW(context);
+   return 0;
+}
+
+// Makes a stream over bytes, taking owned (if any) to free on close
+static SDL_RWops* MakeStream(const Uint8* data, Sint64 size, Uint8* owned)
+{
+   ArchiveStream* stream = (ArchiveStream*)SDL_malloc(sizeof(ArchiveStream));
+   SDL_RWops* context = SDL_AllocRW();
+   if (!stream || !context) {
+      SDL_free(stream);
+      SDL_free(owned);
+      if (context) {
+         SDL_FreeRW(context);
+      }
+      return nullptr;
+   }
+   stream->data = data;
+   stream->size = size;
+   stream->position = 0;
+   stream->owned = owned;
+   context->size = StreamSize;
+   context->seek = StreamSeek;
+   context->read = StreamRead;
+   context->write = StreamWrite;
+   context->close = StreamClose;
+   context->type = ARCHIVESTREAM;
+   context->hidden.unknown.data1 = stream;
+   return context;
+}
+
+// Reads a whole loose file
+static bool ReadWholeFile(const char* fileName, vector<Uint8>& bytes)
+{
+   SDL_RWops* file = SDL_RWFromFile(fileName, "rb");
+   if (!file) {
+      return false;
+   }
+   Sint64 size = SDL_RWsize(file);
+   bool read = (size >= 0);
+   if (read) {
+      bytes.resize((size_t)size);
+      read = (size == 0 || SDL_RWread(file, &bytes[0], 1, (size_t)size) == (size_t)size);
+   }
+   SDL_RWclose(file);
+   return read;
+}
+
+// Constructor
+SDLArchive::SDLArchive()
+{
+}
+
+// Destructor
+SDLArchive::~SDLArchive()
+{
+   Shutdown();
+}
+
+// Instance function
+SDLArchive* SDLArchive::Instance()
+{
+   // Lazy instantiation
+   static SDLArchive instance;
+   return &instance;
+}
+
+// Packs files into an archive
+bool SDLArchive::Pack(const char* archiveName, const char* const* fileNames, int count, bool compress)
+{
+   // Read (and maybe squash) everything first, skipping names already packed
+   vector<string> names;
+   vector<vector<Uint8> > stored;
+   vector<Uint32> sizes;
+   vector<Uint16> flags;
+   for (int ii = 0; ii < count; ++ii) {
+      string key = ArchiveKey(fileNames[ii]);
+      bool duplicate = false;
+      for (unsigned int jj = 0; jj < names.size() && !duplicate; ++jj) {
+         duplicate = (names[jj] == key);
+      }
+      if (duplicate) {
+         continue;
+      }
+      vector<Uint8> bytes;
+      if (!ReadWholeFile(fileNames[ii], bytes) || key.size() > 0xFFFF) {
+         return false;
+      }
+      Uint16 flag = 0;
+#ifdef SDLWRAPPERS_LZ4
+      if (compress && !bytes.empty() && bytes.size() <= LZ4_MAX_INPUT_SIZE) {
+         vector<Uint8> squashed(LZ4_compressBound((int)bytes.size()));
+         int squashedSize = LZ4_compress_default((const char*)&bytes[0], (char*)&squashed[0],
+            (int)bytes.size(), (int)squashed.size());
+         if (squashedSize > 0 && (size_t)squashedSize < bytes.size()) {
+            squashed.resize(squashedSize);
+            sizes.push_back((Uint32)bytes.size());
+            bytes.swap(squashed);
+            flag = entryLZ4;
+         }
+      }
+#endif
+      if (flag == 0) {
+         sizes.push_back((Uint32)bytes.size());
+      }
+      names.push_back(key);
+      stored.push_back(bytes);
+      flags.push_back(flag);
+   }
+
+   // Slots at most half full keeps the probes short
+   Uint32 entryCount = (Uint32)names.size();
+   Uint32 slotCount = 1;
+   while (slotCount < entryCount * 2) {
+      slotCount <<= 1;
+   }
+   vector<Uint32> slots(slotCount, 0);
+   vector<Uint64> hashes;
+   for (Uint32 ii = 0; ii < entryCount; ++ii) {
+      Uint64 hash = NameHash(names[ii]);
+      Uint32 slot = (Uint32)hash & (slotCount - 1);
+      while (slots[slot] != 0) {
+         slot = (slot + 1) & (slotCount - 1);
+      }
+      slots[slot] = ii + 1;
+      hashes.push_back(hash);
+   }
+
+   // Work out where everything goes
+   Uint64 offset = archiveHeaderSize + (Uint64)slotCount * 4 + (Uint64)entryCount * archiveEntrySize;
+   vector<Uint32> nameOffsets;
+   for (Uint32 ii = 0; ii < entryCount; ++ii) {
+      nameOffsets.push_back((Uint32)offset);
+      offset += names[ii].size();
+   }
+   vector<Uint64> offsets;
+   for (Uint32 ii = 0; ii < entryCount; ++ii) {
+      offset = (offset + ARCHIVEALIGNMENT - 1) & ~(Uint64)(ARCHIVEALIGNMENT - 1);
+      offsets.push_back(offset);
+      offset += stored[ii].size();
+   }
+
+   SDL_RWops* file = SDL_RWFromFile(archiveName, "wb");
+   if (!file) {
+      return false;
+   }
+
+   // Header and table of contents
+   bool written = SDL_RWwrite(file, archiveMagic, 1, 4) == 4 && SDL_WriteLE32(file, archiveVersion) == 1
+      && SDL_WriteLE32(file, entryCount) == 1 && SDL_WriteLE32(file, slotCount) == 1;
+   for (Uint32 ii = 0; ii < slotCount && written; ++ii) {
+      written = SDL_WriteLE32(file, slots[ii]) == 1;
+   }
+   for (Uint32 ii = 0; ii < entryCount && written; ++ii) {
+      written = SDL_WriteLE64(file, hashes[ii]) == 1 && SDL_WriteLE64(file, offsets[ii]) == 1
+         && SDL_WriteLE32(file, (Uint32)stored[ii].size()) == 1 && SDL_WriteLE32(file, sizes[ii]) == 1
+         && SDL_WriteLE32(file, nameOffsets[ii]) == 1 && SDL_WriteLE16(file, (Uint16)names[ii].size()) == 1
+         && SDL_WriteLE16(file, flags[ii]) == 1;
+   }
+   for (Uint32 ii = 0; ii < entryCount && written; ++ii) {
+      written = SDL_RWwrite(file, names[ii].c_str(), 1, names[ii].size()) == names[ii].size();
+   }
+
+   // Data
+   const Uint8 padding[ARCHIVEALIGNMENT] = { 0 };
+   for (Uint32 ii = 0; ii < entryCount && written; ++ii) {
+      Sint64 position = SDL_RWtell(file);
+      SDL_RWwrite(file, padding, 1, (size_t)(offsets[ii] - position));
+      written = stored[ii].empty() || SDL_RWwrite(file, &stored[ii][0], 1, stored[ii].size()) == stored[ii].size();
+   }
+   written = (SDL_RWclose(file) == 0) && written;
+   return written;
+}
+
+// Maps an archive
+int SDLArchive::Mount(const char* archiveName)
+{
+   MappedFile* file = new MappedFile();
+   if (!file->Open(archiveName) || file->Size() < archiveHeaderSize) {
+      delete file;
+      return -1;
+   }
+
+   // Make sure it's one of ours and everything in it is inside the file
+   const Uint8* data = file->Data();
+   Uint64 size = file->Size();
+   Archive archive;
+   archive.file = file;
+   archive.count = Read32(data + 8);
+   archive.slotCount = Read32(data + 12);
+   archive.slots = data + archiveHeaderSize;
+   archive.entries = archive.slots + (size_t)archive.slotCount * 4;
+   Uint64 tableEnd = archiveHeaderSize + (Uint64)archive.slotCount * 4 + (Uint64)archive.count * archiveEntrySize;
+   bool valid = memcmp(data, archiveMagic, 4) == 0 && Read32(data + 4) == archiveVersion
+      && archive.slotCount != 0 && (archive.slotCount & (archive.slotCount - 1)) == 0
+      && archive.count <= archive.slotCount && tableEnd <= size;
+   for (Uint32 ii = 0; ii < archive.count && valid; ++ii) {
+      const Uint8* entry = archive.entries + (size_t)ii * archiveEntrySize;
+      Uint64 offset = Read64(entry + 8);
+      Uint32 nameOffset = Read32(entry + 24);
+      valid = offset <= size && Read32(entry + 16) <= size - offset
+         && (Uint64)nameOffset + Read16(entry + 28) <= size;
+   }
+   for (Uint32 ii = 0; ii < archive.slotCount && valid; ++ii) {
+      valid = Read32(archive.slots + (size_t)ii * 4) <= archive.count;
+   }
+   if (!valid) {
+      delete file;
+      return -1;
+   }
+
+   lock_guard<mutex> guard(lock);
+   // Reuse a slot an unmounted archive left
+   for (unsigned int ii = 0; ii < archives.size(); ++ii) {
+      if (!archives[ii].file) {
+         archives[ii] = archive;
+         return (int)ii;
+      }
+   }
+   archives.push_back(archive);
+   return (int)archives.size() - 1;
+}
+
+// Unmaps an archive
+void SDLArchive::Unmount(int archiveIndex)
+{
+   lock_guard<mutex> guard(lock);
+   if (archiveIndex < 0 || archiveIndex >= (int)archives.size()) {
+      return;
+   }
+   delete archives[archiveIndex].file;
+   archives[archiveIndex].file = nullptr;
+}
+
+// Unmaps every archive
+void SDLArchive::Shutdown()
+{
+   lock_guard<mutex> guard(lock);
+   for (unsigned int ii = 0; ii < archives.size(); ++ii) {
+      delete archives[ii].file;
+   }
+   archives.clear();
+}
+
+// Finds an entry, newest archive first
+const Uint8* SDLArchive::FindEntry(const string& key, const Archive** owner) const
+{
+   Uint64 hash = NameHash(key);
+   for (int ii = (int)archives.size() - 1; ii >= 0; --ii) {
+      const Archive& archive = archives[ii];
+      if (!archive.file) {
+         continue;
+      }
+      const Uint8* data = archive.file->Data();
+      Uint32 mask = archive.slotCount - 1;
+      for (Uint32 slot = (Uint32)hash & mask, probes = 0; probes < archive.slotCount; slot = (slot + 1) & mask, ++probes) {
+         Uint32 index = Read32(archive.slots + (size_t)slot * 4);
+         if (index == 0) {
+            break;
+         }
+         const Uint8* entry = archive.entries + (size_t)(index - 1) * archiveEntrySize;
+         if (Read64(entry) == hash && Read16(entry + 28) == (Uint16)key.size()
+            && memcmp(data + Read32(entry + 24), key.c_str(), key.size()) == 0) {
+            *owner = &archive;
+            return entry;
+         }
+      }
+   }
+   return nullptr;
+}
+
+// Returns true if a mounted archive has the file
+bool SDLArchive::Contains(const char* fileName) const
+{
+   const Archive* owner = nullptr;
+   lock_guard<mutex> guard(lock);
+   return FindEntry(ArchiveKey(fileName), &owner) != nullptr;
+}
+
+// Opens a file from the archives, or from disk
+SDL_RWops* SDLArchive::Open(const char* fileName) const
+{
+   if (!fileName) {
+      return nullptr;
+   }
+   string key = ArchiveKey(fileName);
+   const Uint8* bytes = nullptr;
+   Uint32 storedSize = 0;
+   Uint32 size = 0;
+   Uint16 flags = 0;
+   {
+      lock_guard<mutex> guard(lock);
+      const Archive* owner = nullptr;
+      const Uint8* entry = FindEntry(key, &owner);
+      if (entry) {
+         bytes = owner->file->Data() + Read64(entry + 8);
+         storedSize = Read32(entry + 16);
+         size = Read32(entry + 20);
+         flags = Read16(entry + 30);
+      }
+   }
+
+   // Not archived, try the disk
+   if (!bytes) {
+      return SDL_RWFromFile(fileName, "rb");
+   }
+
+   // Stored as is, read it straight from the mapping
+   if ((flags & entryLZ4) == 0) {
+      return MakeStream(bytes, storedSize, nullptr);
+   }
+
+#ifdef SDLWRAPPERS_LZ4
+   Uint8* unpacked = (Uint8*)SDL_malloc(size > 0 ? size : 1);
+   if (!unpacked) {
+      SDL_OutOfMemory();
+      return nullptr;
+   }
+   if (LZ4_decompress_safe((const char*)bytes, (char*)unpacked, (int)storedSize, (int)size) != (int)size) {
+      SDL_free(unpacked);
+      SDL_SetError("Corrupt LZ4 data in archive for %s", fileName);
+      return nullptr;
+   }
+   return MakeStream(unpacked, size, unpacked);
+#else
+   SDL_SetError("%s is LZ4 compressed, build with SDLWRAPPERS_LZ4 to read it", fileName);
+   return nullptr;
+#endif
+}
+
+// The bytes behind an archive stream
+const Uint8* SDLArchive::Memory(SDL_RWops* stream, size_t& size)
+{
+   if (!stream || stream->type != ARCHIVESTREAM) {
+      size = 0;
+      return nullptr;
+   }
+   ArchiveStream* archived = (ArchiveStream*)stream->hidden.unknown.data1;
+   size = (size_t)archived->size;
+   return archived->data;
+}
+
+// The part of a file name after the last dot
+const char* SDLArchive::Extension(const char* fileName)
+{
+   if (!fileName) {
+      return "";
+   }
+   const char* dot = strrchr(fileName, '.');
+   if (!dot || strchr(dot, '/') || strchr(dot, '\\')) {
+      return "";
+   }
+   return dot + 1;
+}
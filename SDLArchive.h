@@ -0,0 +1,99 @@
+#ifndef SDLARCHIVE_H_
+#define SDLARCHIVE_H_
+
+// Defines
+#define ARCHIVEALIGNMENT 16
+#define ARCHIVESTREAM 0x41524348
+
+// Includes
+#include <vector>
+#include <string>
+#include <mutex>
+#include <SDL.h>
+#include "SDLMappedFile.h"
+
+// Using statements
+using std::vector;
+using std::string;
+using std::mutex;
+
+// Archives are:
+//   "SDLA", Uint32 version, Uint32 entry count, Uint32 slot count
+//   per slot: Uint32 entry index + 1 (0 is empty), open addressed on the name hash
+//   per entry: Uint64 name hash, Uint64 data offset, Uint32 stored bytes, Uint32 bytes,
+//              Uint32 name offset, Uint16 name length, Uint16 flags
+//   the names, back to back
+//   the data, each entry starting on an ARCHIVEALIGNMENT byte boundary
+// All little endian. Names use forward slashes, so "art\ship.png" and "art/ship.png" match.
+
+// Mounts archives and hands out their files as SDL_RWops straight over the mapped memory.
+// Anything not in a mounted archive is opened from disk, so loose files keep working and
+// an archive can be dropped in without changing any load calls.
+class SDLArchive {
+private:
+   // One mounted archive
+   struct Archive {
+      MappedFile* file;
+      Uint32 count;
+      Uint32 slotCount;
+      const Uint8* slots;
+      const Uint8* entries;
+   };
+
+   // Members, newest mount last
+   vector<Archive> archives;
+
+   // Loader threads open files while the game mounts things
+   mutable mutex lock;
+
+   // Constructor
+   SDLArchive();
+
+   // Copy Constructor
+   SDLArchive(const SDLArchive& rhs) {};
+
+   // Assignment Operator
+   SDLArchive& operator=(const SDLArchive& rhs) { return *this; }
+
+   // Finds an entry, returns nullptr if no mounted archive has it (call with the lock held)
+   const Uint8* FindEntry(const string& key, const Archive** owner) const;
+
+public:
+   // Destructor
+   ~SDLArchive();
+
+   // Gets the instance
+   static SDLArchive* Instance();
+
+   // Packs files into an archive. With compress set (and SDLWRAPPERS_LZ4 defined) each file
+   // is LZ4 compressed, and kept that way if it came out smaller. Returns false if a file
+   // couldn't be read or the archive couldn't be written.
+   static bool Pack(const char* archiveName, const char* const* fileNames, int count, bool compress = false);
+
+   // Maps an archive. Its files are found before those of archives mounted earlier.
+   // Returns the archive index, or -1 if it couldn't be opened or isn't an archive.
+   int Mount(const char* archiveName);
+
+   // Unmaps an archive. Nothing opened from it (music still streaming, say) may be in use.
+   void Unmount(int archiveIndex);
+
+   // Unmaps every archive
+   void Shutdown();
+
+   // Returns true if a mounted archive has the file
+   bool Contains(const char* fileName) const;
+
+   // Opens a file from the archives, or from disk if none has it. Close it with SDL_RWclose
+   // (or let whatever it's passed to with freesrc set do it). Returns nullptr if it can't be found.
+   SDL_RWops* Open(const char* fileName) const;
+
+   // The bytes behind a stream Open returned for an archived file, so they can be used in place.
+   // Returns nullptr for anything else.
+   static const Uint8* Memory(SDL_RWops* stream, size_t& size);
+
+   // The part of a file name after the last dot ("" if there isn't one). Streams don't carry
+   // their name, so pass this to the typed loaders for formats that can't be sniffed (TGA, MIDI).
+   static const char* Extension(const char* fileName);
+};
+
+#endif // SDLARCHIVE_H_
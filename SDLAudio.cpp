@@ -1,339 +1,2010 @@
-#include "SDLAudio.h"
-#include <cassert>
-#include <cstring>
-
-#include <iostream>
-#include <string>
-using std::cout;
-using std::string;
-
-// Sound Effect Constructor
-SDLAudio::SoundEffect::SoundEffect(Mix_Chunk* effect, const char* fileName) : effect(effect),
-fileName(fileName), refCount(1) {
-    channels.clear();
-}
-
-// Constructor
-SDLAudio::SDLAudio() {
-    music = nullptr;
-    pausedMusic = false;
-    soundCount = 0;
-}
-
-// Assignment operator & Copy Constructor (Not used)
-SDLAudio::SDLAudio(const SDLAudio& rhs) { }
-SDLAudio& SDLAudio::operator=(const SDLAudio& rhs) { return *this; }
-
-// Destructor
-SDLAudio::~SDLAudio() {
-    Shutdown();
-}
-
-// Instance function
-SDLAudio* SDLAudio::Instance() {
-    // Lazy instantiation
-    static SDLAudio instance;
-    return &instance;
-}
-
-// Initializes all audio
-void SDLAudio::Init() {
-    // Stop any previously loaded stuff
-    Shutdown();
-
-    // Initialize support for all these types
-    int mask = MIX_INIT_FLAC | MIX_INIT_MOD
-        | MIX_INIT_MP3 | MIX_INIT_OGG;
-
-    // Attempt to initialize for all types
-    assert(Mix_Init(mask) == mask && "Unable to Initialize for all file types");
-
-    // Open audio channels
-    assert(Mix_OpenAudio(MIX_DEFAULT_FREQUENCY, MIX_DEFAULT_FORMAT,
-        MIX_DEFAULT_CHANNELS, 4096) != -1 && "Unable to Open Audio channels");
-
-    // Set the Audio Hook for finished sound effects
-    Mix_ChannelFinished((&ChannelFinished));
-}
-
-// Cleans up any dynamic memory allocated for audio
-void SDLAudio::Shutdown() {
-
-    // Stop & Unload any music
-    UnloadMusic();
-
-    // Stop & Unload any sound effects
-    if (soundEffects.size() > 0) {
-        Mix_HaltChannel(-1);
-        for (unsigned int ii = 0; ii < soundEffects.size(); ++ii) {
-            // Unload the mix chunk
-            Mix_FreeChunk(soundEffects[ii].effect);
-        }
-        // Clear the vector
-        soundEffects.clear();
-    }
-
-    soundCount = 0;
-
-    // Close the audio
-    Mix_CloseAudio();
-
-    // Quit the SDL sound
-    Mix_Quit();
-}
-
-// Loads a song for playing
-void SDLAudio::LoadMusic(const char* fileName) {
-    // Clean up any existing song
-    UnloadMusic();
-    // Load the song
-    music = Mix_LoadMUS(fileName);
-    assert(music != nullptr && "Failed to load the music file");
-}
-
-// Changes the loaded song & instantly begins playing it
-void SDLAudio::ChangeMusic(const char* fileName, int loop) {
-    // Clean up any existing song
-    UnloadMusic();
-    // Load the song
-    music = Mix_LoadMUS(fileName);
-    assert(music != nullptr && "Failed to load the music file");
-
-    // Play the song
-    assert(Mix_PlayMusic(music, 1) != -1 && "Failed to play the new song during changeover");
-}
-
-// Unloads the loaded music
-void SDLAudio::UnloadMusic() {
-    if (music) {
-        Mix_FreeMusic(music);
-        music = nullptr;
-    }
-    pausedMusic = false;
-}
-
-void SDLAudio::StartMusic(int loop, bool overridePause, int milliseconds, bool fade) {
-    // If the song is valid and...
-    // We're not paused
-    // Or we are paused and can override pauses
-    if (music && (!pausedMusic || (pausedMusic && overridePause))) {
-        if (fade) {
-            assert(Mix_FadeInMusic(music, loop, milliseconds) != -1 && "An error occurred attempting to play the song");
-        }
-        else {
-            assert(Mix_PlayMusic(music, loop) != -1 && "An error occurred attempting to play the song");
-        }
-    }
-    // We're paused and cannot override pauses
-    else {
-        // Resume
-        Mix_ResumeMusic();
-        pausedMusic = false;
-    }
-}
-
-// Play music (0 means play 0 times, -1 forever)
-void SDLAudio::PlayMusic(int loop, bool overridePause) {
-    StartMusic(loop, overridePause, 0, false);
-}
-
-// Stop music
-void SDLAudio::StopMusic() {
-    Mix_HaltMusic();
-    pausedMusic = false;
-}
-
-// Pause music
-void SDLAudio::PauseMusic() {
-    Mix_PauseMusic();
-    pausedMusic = true;
-}
-
-// Fade out music
-void SDLAudio::FadeOutMusic(int milliseconds) {
-    assert(Mix_FadeOutMusic(milliseconds) == 1 && "Failed to initiate the Fade Out of a song");
-}
-
-// Start playing a song, fading in at the start
-void SDLAudio::FadeInMusic(int milliseconds, int loop, bool overridePause) {
-    StartMusic(loop, overridePause, milliseconds, true);
-}
-
-// Get the volume
-int SDLAudio::MusicVolume() {
-    return Mix_VolumeMusic(-1);
-}
-
-// 0 = mute, 128 = MIX_MAX_VOLUME = max
-void SDLAudio::MusicVolume(int volume) {
-    // returns the old volume (int)
-    Mix_VolumeMusic(volume);
-}
-
-// Mutes the music
-void SDLAudio::MuteMusic() {
-    this->MusicVolume(0);
-}
-
-bool SDLAudio::ValidSoundIndex(int soundIndex) const {
-    return (soundIndex >= 0 && soundIndex < soundEffects.size() && soundEffects[soundIndex].refCount > 0);
-}
-
-// Loads a sound effect
-int SDLAudio::LoadSound(const char* fileName) {
-    // For every loaded sound
-    for (unsigned int ii = 0; ii < soundEffects.size(); ++ii) {
-        // Does it match?
-        if (soundEffects[ii].fileName == fileName) {
-            if (soundEffects[ii].refCount <= 0) {
-                Mix_Chunk* newSound = Mix_LoadWAV(fileName);
-                assert(newSound != nullptr && "Failed to load Sound Effect");
-                soundEffects[ii].effect = newSound;
-                soundEffects[ii].refCount = 1;
-                return ii;
-            }
-            // Increase ref count, return that number
-            soundEffects[ii].refCount++;
-            return ii;
-        }
-        // Use this spot if it's empty
-        else if (soundEffects[ii].refCount <= 0) {
-            Mix_Chunk* newSound = Mix_LoadWAV(fileName);
-            assert(newSound != nullptr && "Failed to load Sound Effect");
-            soundEffects[ii].effect = newSound;
-            soundEffects[ii].refCount = 1;
-            soundEffects[ii].fileName = fileName;
-            return ii;
-        }
-    }
-
-    // Actually load this fucker
-    Mix_Chunk* newSound = Mix_LoadWAV(fileName);
-    assert(newSound != nullptr && "Failed to load Sound Effect");
-    SoundEffect newGuy(newSound, fileName);
-    // Stuff into list, return index
-    soundEffects.push_back(newGuy);
-    return (int)soundEffects.size() - 1;
-}
-
-// Unloads a sound
-void SDLAudio::UnloadSound(int soundIndex) {
-    // Only bother if given a valid index
-    if (ValidSoundIndex(soundIndex)) {
-        // Decrement the refCount at the chosen index
-        soundEffects[soundIndex].refCount--;
-        // If the refCount has hit 0, unload the sound
-        if (soundEffects[soundIndex].refCount <= 0) {
-            // Unload the effect, if he exists
-            Mix_FreeChunk(soundEffects[soundIndex].effect);
-            soundEffects[soundIndex].effect = nullptr;
-            soundEffects[soundIndex].refCount = 0;
-            soundEffects[soundIndex].fileName = "UNINITIALIZED";
-        }
-    }
-}
-
-// Plays a sound effect
-int SDLAudio::PlaySoundEffect(int soundIndex, int loop) {
-    return StartSound(soundIndex, loop, 0, false);
-}
-
-// This function is called when a SoundEffect is finished playing. It removes a channel from a SoundEffect
-void ChannelFinished(int channel) {
-    cout << "Sound finished... ";
-    // For every sound effect
-    for (unsigned int ii = 0; ii < SDLAudio::Instance()->soundEffects.size(); ++ii) {
-        // For every channel it has
-        for (unsigned int jj = 0; jj < SDLAudio::Instance()->soundEffects[ii].channels.size(); ++jj) {
-            if (channel == SDLAudio::Instance()->soundEffects[ii].channels[jj]) {
-                SDLAudio::Instance()->soundEffects[ii].channels.erase(SDLAudio::Instance()->soundEffects[ii].channels.begin() + jj);
-                SDLAudio::Instance()->soundCount -= 1;
-                cout << "And removed! " << SDLAudio::Instance()->soundCount << "\n";
-                return;
-            }
-        }
-    }
-}
-
-// Stop sound
-void SDLAudio::StopSoundEffect(int soundIndex, int channel) {
-    // Don't bother if it's a bad index
-    if (ValidSoundIndex(soundIndex) && channel != -1) {
-        for (unsigned int ii = 0; ii < soundEffects[soundIndex].channels.size(); ++ii) {
-            // If we have this channel... stop it
-            if (soundEffects[soundIndex].channels[ii] == channel) {
-                Mix_HaltChannel(soundEffects[soundIndex].channels[ii]);
-                // Callback gets called automatically
-            }
-        }
-    }
-}
-
-// Fade in sound
-int SDLAudio::FadeInSoundEffect(int soundIndex, int milliseconds, int loop) {
-    return StartSound(soundIndex, loop, milliseconds, true);
-}
-
-// Actually starts the sound effect. This function is shared between Play and FadeIn
-int SDLAudio::StartSound(int soundIndex, int loop, int milliseconds, bool fade) {
-    // Only bother if given a valid index
-    int channel = -1;
-    if (ValidSoundIndex(soundIndex)) {
-        if (!fade) {
-            channel = Mix_PlayChannel(-1, soundEffects[soundIndex].effect, loop);
-        }
-        else {
-            channel = Mix_FadeInChannel(-1, soundEffects[soundIndex].effect, loop, milliseconds);
-        }
-        string temp(Mix_GetError());
-        // If there are no channels left, it will not play. This is okay.
-        if (channel == -1 && strcmp(Mix_GetError(), "No free channels available") != 0) {
-            // Any other reason though,... freak out
-            assert(channel != -1 && "An error occurred while attempting to play a sound effect");
-        }
-        // If it played
-        else if (channel != -1) {
-            // Keep track
-            ++soundCount;
-            cout << "Played: " << soundCount << "\n";
-            soundEffects[soundIndex].channels.push_back(channel);
-        }
-    }
-    return channel;
-}
-
-// Fade out sound
-void SDLAudio::FadeOutSoundEffect(int soundIndex, int channel, int milliseconds) {
-    // Don't bother if the index is bad
-    if (ValidSoundIndex(soundIndex)) {
-        Mix_FadeOutChannel(channel, milliseconds);
-    }
-}
-
-// Pause sound
-void SDLAudio::PauseSoundEffect(int soundIndex, int channel) {
-    if (ValidSoundIndex(soundIndex)) {
-        Mix_Pause(channel);
-    }
-}
-
-// Mute sound
-void SDLAudio::MuteSoundEffects() {
-    Mix_Volume(-1, 0);
-}
-
-// Set the sound effects volume, 0 = mute, 128 = max
-void SDLAudio::SoundEffectsVolume(int newVolume) {
-    Mix_Volume(-1, newVolume);
-}
-
-// Get the sound effects volume
-int SDLAudio::SoundEffectsVolume() {
-    return Mix_Volume(-1, -1);
-}
-
-// Mute sound & music
-void SDLAudio::Mute() {
-    MuteMusic();
-    MuteSoundEffects();
+#include "SDLAudio.h"
+#include "SDLHash.h"
+#include "SDLArchive.h"
+#include <cassert>
+#include <cstring>
+#include <cstdio>
+
+#include <string>
+
+// SSE2 is always there on x64, and on x86 when the compiler is told it can use it
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SDLAUDIO_SSE2
+#include <emmintrin.h>
+#endif
+
+using std::string;
+using std::lock_guard;
+using std::unique_lock;
+
+// Sound Effect Constructor
+SDLAudio::SoundEffect::SoundEffect(Mix_Chunk* effect, const string& fileName) : effect(effect),
+fileName(fileName), refCount(1), priority(0), maxInstances(0), minInterval(0), lastPlayed(0), bank(-1),
+loading(false), ticket(0), bus(BUS_SFX), loadTicks(0) {
+}
+
+// Constructor
+SDLAudio::SDLAudio() {
+    music = nullptr;
+    pausedMusic = false;
+    soundCount = 0;
+    channelCount = 0;
+    ClearChannelOwners();
+    residentBytes = 0;
+    mappedBytes = 0;
+    ResetCounters();
+    stopLoaders = false;
+    pendingLoads = 0;
+    nextTicket = 0;
+    musicTicket = 0;
+    for (int ii = 0; ii < TRACKVOICES; ++ii) {
+        tracks[ii].chunk = nullptr;
+        tracks[ii].state = TRACK_FREE;
+    }
+    trackLock = 0;
+    tracksHooked = false;
+    trackVolume = MIX_MAX_VOLUME;
+    trackFrequency = 0;
+    trackFormat = 0;
+    trackFrameSize = 0;
+    playTicket = 0;
+    queueTicket = 0;
+    mixFrequency = 0;
+    mixFormat = 0;
+    mixChannels = 0;
+    mixFrames = 0;
+    ResetTiming();
+    ResetBuses();
+    listenerX = listenerY = 0.0f;
+    falloffMin = 100.0f;
+    falloffMax = 1000.0f;
+    panWidth = 500.0f;
+    for (int ii = 0; ii < MAXCHANNELS; ++ii) {
+        emitterX[ii] = emitterY[ii] = 0.0f;
+        channelGains[ii] = 0x7FFF7FFF;
+        positioned[ii] = false;
+    }
+}
+
+// Assignment operator & Copy Constructor (Not used)
+SDLAudio::SDLAudio(const SDLAudio& rhs) { }
+SDLAudio& SDLAudio::operator=(const SDLAudio& rhs) { return *this; }
+
+// Destructor
+SDLAudio::~SDLAudio() {
+    Shutdown();
+}
+
+// Instance function
+SDLAudio* SDLAudio::Instance() {
+    // Lazy instantiation
+    static SDLAudio instance;
+    return &instance;
+}
+
+// Initializes all audio
+void SDLAudio::Init(int frequency, Uint16 format, int channels, int chunkSize) {
+    // Stop any previously loaded stuff
+    Shutdown();
+
+    // Initialize support for all these types
+    int mask = MIX_INIT_FLAC | MIX_INIT_MOD
+        | MIX_INIT_MP3 | MIX_INIT_OGG;
+
+    // Attempt to initialize for all types (kept out of the asserts so release builds still do it)
+    int initialized = Mix_Init(mask);
+    assert(initialized == mask && "Unable to Initialize for all file types");
+
+    // Ask audio streams for libsamplerate's best resampler, unless told otherwise. SDL only
+    // reads this when the audio subsystem starts (Mix_OpenAudio does that if nothing else has),
+    // and it only does anything when SDL was built with libsamplerate.
+    if (!SDL_GetHint(SDL_HINT_AUDIO_RESAMPLING_MODE)) {
+        SDL_SetHint(SDL_HINT_AUDIO_RESAMPLING_MODE, "best");
+    }
+
+    // Open audio channels
+    int opened = Mix_OpenAudio(frequency, format, channels, chunkSize);
+    assert(opened != -1 && "Unable to Open Audio channels");
+
+    // Remember what we actually got
+    Mix_QuerySpec(&mixFrequency, &mixFormat, &mixChannels);
+    mixFrames = chunkSize;
+
+    // Buses start over at full volume
+    ResetBuses();
+
+    // Time every callback
+    ResetTiming();
+    Mix_SetPostMix(&PostMix, this);
+
+    // The channel table only covers MAXCHANNELS
+    channelCount = Mix_AllocateChannels(-1);
+    assert(channelCount <= MAXCHANNELS && "More mixer channels than MAXCHANNELS");
+
+    // Set the Audio Hook for finished sound effects
+    Mix_ChannelFinished((&ChannelFinished));
+}
+
+// Initializes all audio with a small buffer
+void SDLAudio::InitLowLatency() {
+    Init(LOWLATENCYFREQUENCY, MIX_DEFAULT_FORMAT, 2, LOWLATENCYCHUNKSIZE);
+}
+
+// Clears the callback timing
+void SDLAudio::ResetTiming() {
+    lastCallback = 0;
+    mixStart = 0;
+    callbackCount = 0;
+    intervalTotal = 0;
+    intervalMax = 0;
+    intervalCount = 0;
+    mixTotal = 0;
+    mixMax = 0;
+    mixCount = 0;
+    underrunCount = 0;
+}
+
+// How the device was opened and how its callback is keeping up
+SDLAudio::AudioTiming SDLAudio::Timing() const {
+    double msPerTick = 1000.0 / SDL_GetPerformanceFrequency();
+    AudioTiming timing;
+    timing.frequency = mixFrequency;
+    timing.format = mixFormat;
+    timing.channels = mixChannels;
+    timing.chunkSize = mixFrames.load();
+    timing.bufferMs = (mixFrequency > 0 ? timing.chunkSize * 1000.0 / mixFrequency : 0.0);
+    Uint64 intervals = intervalCount.load();
+    timing.averageIntervalMs = (intervals > 0 ? intervalTotal.load() * msPerTick / intervals : 0.0);
+    timing.maxIntervalMs = intervalMax.load() * msPerTick;
+    Uint64 mixes = mixCount.load();
+    timing.averageMixMs = (mixes > 0 ? mixTotal.load() * msPerTick / mixes : 0.0);
+    timing.maxMixMs = mixMax.load() * msPerTick;
+    timing.callbacks = callbackCount.load();
+    timing.underruns = underrunCount.load();
+    return timing;
+}
+
+// Runs at the end of every mixer callback on the audio thread
+void PostMix(void* userData, Uint8* stream, int length) {
+    SDLAudio* owner = (SDLAudio*)userData;
+    Uint64 now = SDL_GetPerformanceCounter();
+    owner->callbackCount++;
+
+    // How many frames this callback is for, whatever chunk size was asked for
+    int frameBytes = SDL_AUDIO_BITSIZE(owner->mixFormat) / 8 * owner->mixChannels;
+    int frames = (frameBytes > 0 ? length / frameBytes : 0);
+    owner->mixFrames = frames;
+
+    // Time since the last callback. Anything over one and a half buffers means the device
+    // was waiting on us.
+    Uint64 last = owner->lastCallback.exchange(now);
+    if (last != 0) {
+        Uint64 interval = now - last;
+        owner->intervalTotal += interval;
+        owner->intervalCount++;
+        if (interval > owner->intervalMax) {
+            owner->intervalMax = interval;
+        }
+        Uint64 buffer = (owner->mixFrequency > 0 ? SDL_GetPerformanceFrequency() * frames / owner->mixFrequency : 0);
+        if (buffer > 0 && interval > buffer + buffer / 2) {
+            owner->underrunCount++;
+        }
+    }
+
+    // The track stream marks when mixing began
+    Uint64 start = owner->mixStart.exchange(0);
+    if (start != 0) {
+        Uint64 spent = now - start;
+        owner->mixTotal += spent;
+        owner->mixCount++;
+        if (spent > owner->mixMax) {
+            owner->mixMax = spent;
+        }
+    }
+}
+
+// Cleans up any dynamic memory allocated for audio
+void SDLAudio::Shutdown() {
+
+    // Stop the loaders and throw away anything they finished
+    StopLoaders();
+
+    // Stop & Unload any tracks
+    HookTracks(false);
+
+    // Stop & Unload any music
+    UnloadMusic();
+
+    // Stop & Unload any sound effects
+    if (soundEffects.size() > 0) {
+        Mix_HaltChannel(-1);
+        for (unsigned int ii = 0; ii < soundEffects.size(); ++ii) {
+            // Unload the mix chunk
+            Mix_FreeChunk(soundEffects[ii].effect);
+        }
+        // Clear the vector
+        soundEffects.clear();
+    }
+    soundLookup.clear();
+    freeSoundSlots.clear();
+
+    // The chunks are gone, so the banks they pointed into can go
+    for (unsigned int ii = 0; ii < soundBanks.size(); ++ii) {
+        delete soundBanks[ii].file;
+    }
+    soundBanks.clear();
+    residentBytes = 0;
+    mappedBytes = 0;
+
+    soundCount = 0;
+    ClearChannelOwners();
+
+    // Close the audio
+    Mix_CloseAudio();
+
+    // Quit the SDL sound
+    Mix_Quit();
+}
+
+// Music formats by extension, the same table Mix_LoadMUS uses. Streams have no name,
+// and MIDI and most tracker formats can't be told apart by their first bytes.
+static Mix_MusicType MusicType(const char* fileName) {
+    const char* extension = SDLArchive::Extension(fileName);
+    static const char* const modules[] = { "669", "AMF", "AMS", "DBM", "DSM", "FAR", "IT", "MED", "MDL",
+        "MOD", "MOL", "MTM", "NST", "OKT", "PTM", "S3M", "STM", "ULT", "UMX", "WOW", "XM" };
+    if (SDL_strcasecmp(extension, "WAV") == 0) {
+        return MUS_WAV;
+    }
+    if (SDL_strcasecmp(extension, "MID") == 0 || SDL_strcasecmp(extension, "MIDI") == 0
+        || SDL_strcasecmp(extension, "KAR") == 0) {
+        return MUS_MID;
+    }
+    if (SDL_strcasecmp(extension, "OGG") == 0) {
+        return MUS_OGG;
+    }
+    if (SDL_strcasecmp(extension, "OPUS") == 0) {
+        return MUS_OPUS;
+    }
+    if (SDL_strcasecmp(extension, "FLAC") == 0) {
+        return MUS_FLAC;
+    }
+    if (SDL_strcasecmp(extension, "MPG") == 0 || SDL_strcasecmp(extension, "MPEG") == 0
+        || SDL_strcasecmp(extension, "MP3") == 0 || SDL_strcasecmp(extension, "MAD") == 0) {
+        return MUS_MP3;
+    }
+    for (unsigned int ii = 0; ii < sizeof(modules) / sizeof(modules[0]); ++ii) {
+        if (SDL_strcasecmp(extension, modules[ii]) == 0) {
+            return MUS_MOD;
+        }
+    }
+    // Let SDL_mixer look at the data
+    return MUS_NONE;
+}
+
+// Opens a song through the archives, typed by its extension like Mix_LoadMUS does
+static Mix_Music* LoadMusicFile(const char* fileName) {
+    return Mix_LoadMUSType_RW(SDLArchive::Instance()->Open(fileName), MusicType(fileName), 1);
+}
+
+// Loads a song for playing
+void SDLAudio::LoadMusic(const char* fileName) {
+    // Any async music still coming is out of date now
+    musicTicket++;
+    // Clean up any existing song
+    UnloadMusic();
+    // Load the song
+    music = LoadMusicFile(fileName);
+    assert(music != nullptr && "Failed to load the music file");
+}
+
+// Changes the loaded song & instantly begins playing it
+void SDLAudio::ChangeMusic(const char* fileName, int loop) {
+    // Any async music still coming is out of date now
+    musicTicket++;
+    // Clean up any existing song
+    UnloadMusic();
+    // Load the song
+    music = LoadMusicFile(fileName);
+    assert(music != nullptr && "Failed to load the music file");
+
+    // Play the song
+    HookTracks(false);
+    int played = Mix_PlayMusic(music, loop);
+    assert(played != -1 && "Failed to play the new song during changeover");
+}
+
+// Unloads the loaded music
+void SDLAudio::UnloadMusic() {
+    if (music) {
+        Mix_FreeMusic(music);
+        music = nullptr;
+    }
+    pausedMusic = false;
+}
+
+void SDLAudio::StartMusic(int loop, bool overridePause, int milliseconds, bool fade) {
+    // Tracks use the music stream too
+    HookTracks(false);
+
+    // If the song is valid and...
+    // We're not paused
+    // Or we are paused and can override pauses
+    if (music && (!pausedMusic || (pausedMusic && overridePause))) {
+        // Kept out of the assert so release builds still play it
+        int played = (fade ? Mix_FadeInMusic(music, loop, milliseconds) : Mix_PlayMusic(music, loop));
+        assert(played != -1 && "An error occurred attempting to play the song");
+    }
+    // We're paused and cannot override pauses
+    else {
+        // Resume
+        Mix_ResumeMusic();
+        pausedMusic = false;
+    }
+}
+
+// Play music (0 means play 0 times, -1 forever)
+void SDLAudio::PlayMusic(int loop, bool overridePause) {
+    StartMusic(loop, overridePause, 0, false);
+}
+
+// Stop music
+void SDLAudio::StopMusic() {
+    Mix_HaltMusic();
+    pausedMusic = false;
+}
+
+// Pause music
+void SDLAudio::PauseMusic() {
+    Mix_PauseMusic();
+    pausedMusic = true;
+}
+
+// Fade out music
+void SDLAudio::FadeOutMusic(int milliseconds) {
+    int fading = Mix_FadeOutMusic(milliseconds);
+    assert(fading == 1 && "Failed to initiate the Fade Out of a song");
+}
+
+// Start playing a song, fading in at the start
+void SDLAudio::FadeInMusic(int milliseconds, int loop, bool overridePause) {
+    StartMusic(loop, overridePause, milliseconds, true);
+}
+
+// Loads music on a loader thread
+void SDLAudio::LoadMusicAsync(const char* fileName, AudioLoadedCallback callback, void* userData) {
+    QueueMusicLoad(fileName, false, 0, callback, userData);
+}
+
+// Changes music on a loader thread
+void SDLAudio::ChangeMusicAsync(const char* fileName, int loop) {
+    QueueMusicLoad(fileName, true, loop, nullptr, nullptr);
+}
+
+// Queues music for the loaders. Only the newest request gets installed.
+void SDLAudio::QueueMusicLoad(const char* fileName, bool play, int loop, AudioLoadedCallback callback, void* userData) {
+    assert(fileName != nullptr && "Tried to load music without a file name");
+    LoadJob job;
+    job.fileName = fileName;
+    job.soundIndex = -1;
+    job.ticket = ++musicTicket;
+    job.isMusic = true;
+    job.play = play;
+    job.loop = loop;
+    job.isTrack = false;
+    job.queued = false;
+    job.fade = 0;
+    job.callback = callback;
+    job.userData = userData;
+    job.chunk = nullptr;
+    job.loadedMusic = nullptr;
+    job.loadTicks = 0;
+    job.cacheDirectory = soundCache;
+    QueueLoad(job);
+}
+
+// Get the volume
+int SDLAudio::MusicVolume() {
+    return Mix_VolumeMusic(-1);
+}
+
+// 0 = mute, 128 = MIX_MAX_VOLUME = max
+void SDLAudio::MusicVolume(int volume) {
+    // returns the old volume (int)
+    Mix_VolumeMusic(volume);
+    // Tracks bypass the mixer's music volume
+    if (volume >= 0) {
+        trackVolume = (volume > MIX_MAX_VOLUME ? MIX_MAX_VOLUME : volume);
+    }
+}
+
+// Mutes the music
+void SDLAudio::MuteMusic() {
+    this->MusicVolume(0);
+}
+
+// Forgets which sound owns every channel
+void SDLAudio::ClearChannelOwners() {
+    for (int ii = 0; ii < MAXCHANNELS; ++ii) {
+        channelOwner[ii].store(NOOWNER);
+        channelStarted[ii] = 0;
+    }
+}
+
+// Which sound is playing on a channel, -1 if none
+int SDLAudio::ChannelOwner(int channel) const {
+    if (channel < 0 || channel >= MAXCHANNELS) {
+        return NOOWNER;
+    }
+    return channelOwner[channel].load();
+}
+
+bool SDLAudio::ValidSoundIndex(int soundIndex) const {
+    return (soundIndex >= 0 && soundIndex < soundEffects.size() && soundEffects[soundIndex].refCount > 0);
+}
+
+// Makes the key a path is looked up by, so "sfx\\hit.wav" and "sfx/hit.wav" are the same sound
+static string SoundKey(const char* fileName) {
+    string key(fileName);
+    for (unsigned int ii = 0; ii < key.size(); ++ii) {
+        if (key[ii] == '\\') {
+            key[ii] = '/';
+        }
+    }
+    return key;
+}
+
+// Loads a sound effect
+int SDLAudio::LoadSound(const char* fileName) {
+    assert(fileName != nullptr && "Tried to load a sound without a file name");
+    string key = SoundKey(fileName);
+
+    // Already loaded? Increase ref count, return that number
+    unordered_map<string, int>::iterator found = soundLookup.find(key);
+    if (found != soundLookup.end()) {
+        SoundEffect& sound = soundEffects[found->second];
+        // Still loading in the background, the caller wants it now so load it here.
+        // The loader's copy gets thrown away when it arrives.
+        if (sound.loading) {
+            sound.effect = DecodeSound(fileName, soundCache, sound.loadTicks);
+            assert(sound.effect != nullptr && "Failed to load Sound Effect");
+            sound.loading = false;
+            CountResident(sound.effect, true);
+        }
+        sound.refCount++;
+        return found->second;
+    }
+
+    // Actually load it
+    Uint64 ticks = 0;
+    Mix_Chunk* newSound = DecodeSound(fileName, soundCache, ticks);
+    assert(newSound != nullptr && "Failed to load Sound Effect");
+    int index = AddSound(newSound, key);
+    soundEffects[index].loadTicks = ticks;
+    CountResident(newSound, true);
+    return index;
+}
+
+// Bumps a counter, nothing else reads these in between so relaxed is enough
+static void Count(atomic<Uint64>& counter, Uint64 amount = 1) {
+    counter.fetch_add(amount, std::memory_order_relaxed);
+}
+
+// Decodes a sound, counting the load and how long it took. Safe on the loader threads.
+Mix_Chunk* SDLAudio::DecodeSound(const char* fileName, const string& cacheDirectory, Uint64& ticks) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    Mix_Chunk* chunk = nullptr;
+    SDL_RWops* file = SDLArchive::Instance()->Open(fileName);
+    if (cacheDirectory.empty()) {
+        chunk = Mix_LoadWAV_RW(file, 1);
+    }
+    else {
+        // The source is hashed straight out of the archive or a mapping of the loose file,
+        // and only decoded on a miss
+        size_t size = 0;
+        const Uint8* data = SDLArchive::Memory(file, size);
+        MappedFile source;
+        if (!data && source.Open(fileName)) {
+            data = source.Data();
+            size = source.Size();
+        }
+        if (data) {
+            Uint64 sourceHash = HashBytes(data, size);
+            char cacheName[64];
+            snprintf(cacheName, sizeof(cacheName), "/%016llx-%d-%04x-%d.pcm", (unsigned long long)sourceHash,
+                mixFrequency, (unsigned int)mixFormat, mixChannels);
+            string cachePath = cacheDirectory + cacheName;
+            chunk = ReadCachedSound(cachePath, sourceHash);
+            if (!chunk) {
+                chunk = ConvertSound(data, size);
+                if (chunk) {
+                    WriteCachedSound(cachePath, sourceHash, chunk);
+                }
+            }
+        }
+        if (file) {
+            SDL_RWclose(file);
+        }
+    }
+    ticks = SDL_GetPerformanceCounter() - start;
+    Count(loadCount);
+    Count(loadTicks, ticks);
+    return chunk;
+}
+
+// Adds or takes away decoded samples from the resident count
+void SDLAudio::CountResident(Mix_Chunk* chunk, bool add) {
+    if (!chunk) {
+        return;
+    }
+    if (add) {
+        Count(residentBytes, chunk->alen);
+    }
+    else {
+        residentBytes.fetch_sub(chunk->alen, std::memory_order_relaxed);
+    }
+}
+
+// Loads a sound effect on a loader thread
+int SDLAudio::LoadSoundAsync(const char* fileName, AudioLoadedCallback callback, void* userData) {
+    assert(fileName != nullptr && "Tried to load a sound without a file name");
+    string key = SoundKey(fileName);
+
+    // Already loaded (or on its way)? Share it
+    unordered_map<string, int>::iterator found = soundLookup.find(key);
+    if (found != soundLookup.end()) {
+        SoundEffect& sound = soundEffects[found->second];
+        sound.refCount++;
+        if (!sound.loading) {
+            if (callback) {
+                callback(found->second, true, userData);
+            }
+        }
+        // Its job is already queued, just wait for that one
+        else {
+            WaitForLoad(sound.ticket, callback, userData);
+        }
+        return found->second;
+    }
+
+    // Hold a slot for it so the index can be handed out now
+    int index = AddSound(nullptr, key);
+    soundEffects[index].loading = true;
+    soundEffects[index].ticket = ++nextTicket;
+    WaitForLoad(soundEffects[index].ticket, callback, userData);
+
+    // The callbacks are called from loadWaiters
+    LoadJob job;
+    job.fileName = fileName;
+    job.soundIndex = index;
+    job.ticket = soundEffects[index].ticket;
+    job.isMusic = false;
+    job.play = false;
+    job.loop = 0;
+    job.isTrack = false;
+    job.queued = false;
+    job.fade = 0;
+    job.callback = nullptr;
+    job.userData = nullptr;
+    job.chunk = nullptr;
+    job.loadedMusic = nullptr;
+    job.loadTicks = 0;
+    job.cacheDirectory = soundCache;
+    QueueLoad(job);
+    return index;
+}
+
+// Adds a callback to the ones waiting on a sound load
+void SDLAudio::WaitForLoad(Uint32 ticket, AudioLoadedCallback callback, void* userData) {
+    if (!callback) {
+        return;
+    }
+    LoadWaiter waiter;
+    waiter.callback = callback;
+    waiter.userData = userData;
+    loadWaiters[ticket].push_back(waiter);
+}
+
+// Returns true once a sound can be played
+bool SDLAudio::SoundReady(int soundIndex) const {
+    return ValidSoundIndex(soundIndex) && soundEffects[soundIndex].effect != nullptr;
+}
+
+// Stores a new sound, reusing a slot an unloaded sound left or adding one
+int SDLAudio::AddSound(Mix_Chunk* chunk, const string& key) {
+    int index = -1;
+    if (!freeSoundSlots.empty()) {
+        index = freeSoundSlots.back();
+        freeSoundSlots.pop_back();
+        soundEffects[index] = SoundEffect(chunk, key);
+    }
+    else {
+        soundEffects.push_back(SoundEffect(chunk, key));
+        index = (int)soundEffects.size() - 1;
+    }
+    soundLookup[key] = index;
+    return index;
+}
+
+// Unloads a sound
+void SDLAudio::UnloadSound(int soundIndex) {
+    // Only bother if given a valid index
+    if (ValidSoundIndex(soundIndex)) {
+        // Decrement the refCount at the chosen index
+        soundEffects[soundIndex].refCount--;
+        // If the refCount has hit 0, unload the sound
+        if (soundEffects[soundIndex].refCount <= 0) {
+            FreeSound(soundIndex);
+        }
+    }
+}
+
+// Frees a sound's chunk and gives its slot back
+void SDLAudio::FreeSound(int soundIndex) {
+    // Halt the channels still playing it first. Mix_FreeChunk stops them too, but without
+    // calling ChannelFinished, so their owners (and soundCount, buses, positions) would stick.
+    for (int ii = 0; ii < channelCount; ++ii) {
+        if (ChannelOwner(ii) == soundIndex) {
+            Mix_HaltChannel(ii);
+        }
+    }
+
+    // Unload the effect, if he exists.
+    // Bank sounds only free the chunk, the samples stay in the mapping.
+    if (soundEffects[soundIndex].bank == -1) {
+        CountResident(soundEffects[soundIndex].effect, false);
+    }
+    Mix_FreeChunk(soundEffects[soundIndex].effect);
+    soundEffects[soundIndex].effect = nullptr;
+    soundEffects[soundIndex].refCount = 0;
+    soundEffects[soundIndex].bank = -1;
+    soundEffects[soundIndex].loading = false;
+    soundLookup.erase(soundEffects[soundIndex].fileName);
+    soundEffects[soundIndex].fileName.clear();
+    freeSoundSlots.push_back(soundIndex);
+}
+
+// Hands a job to the loader threads, starting them the first time
+void SDLAudio::QueueLoad(const LoadJob& job) {
+    if (loaders.empty()) {
+        stopLoaders = false;
+        for (int ii = 0; ii < LOADTHREADS; ++ii) {
+            loaders.push_back(thread(&SDLAudio::LoadWorker, this));
+        }
+    }
+    {
+        lock_guard<mutex> lock(loadLock);
+        loadQueue.push_back(job);
+    }
+    pendingLoads++;
+    loadWake.notify_one();
+}
+
+// Loader thread, decodes jobs until told to stop
+void SDLAudio::LoadWorker() {
+    for (;;) {
+        LoadJob job;
+        {
+            unique_lock<mutex> lock(loadLock);
+            while (!stopLoaders && loadQueue.empty()) {
+                loadWake.wait(lock);
+            }
+            if (stopLoaders) {
+                return;
+            }
+            job = loadQueue.front();
+            loadQueue.pop_front();
+        }
+
+        // The slow part, with no locks held
+        if (job.isMusic) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            job.loadedMusic = LoadMusicFile(job.fileName.c_str());
+            job.loadTicks = SDL_GetPerformanceCounter() - start;
+            Count(loadCount);
+            Count(loadTicks, job.loadTicks);
+        }
+        else {
+            job.chunk = DecodeSound(job.fileName.c_str(), job.cacheDirectory, job.loadTicks);
+        }
+
+        lock_guard<mutex> lock(loadLock);
+        finishedLoads.push_back(job);
+    }
+}
+
+// Stops the loader threads and frees whatever they loaded that wasn't installed
+void SDLAudio::StopLoaders() {
+    {
+        lock_guard<mutex> lock(loadLock);
+        stopLoaders = true;
+    }
+    loadWake.notify_all();
+    for (unsigned int ii = 0; ii < loaders.size(); ++ii) {
+        loaders[ii].join();
+    }
+    loaders.clear();
+
+    loadQueue.clear();
+    for (unsigned int ii = 0; ii < finishedLoads.size(); ++ii) {
+        Mix_FreeChunk(finishedLoads[ii].chunk);
+        if (finishedLoads[ii].loadedMusic) {
+            Mix_FreeMusic(finishedLoads[ii].loadedMusic);
+        }
+    }
+    finishedLoads.clear();
+    loadWaiters.clear();
+    pendingLoads = 0;
+    stopLoaders = false;
+}
+
+// Installs finished async loads and calls their callbacks
+void SDLAudio::Update() {
+    // Pan and attenuate positioned sounds
+    UpdatePositions();
+
+    // Ducking and bus volumes
+    UpdateBuses();
+
+    // Free tracks the audio thread has finished with
+    if (tracksHooked) {
+        ReleaseTracks();
+    }
+
+    if (pendingLoads == 0) {
+        return;
+    }
+
+    vector<LoadJob> done;
+    {
+        lock_guard<mutex> lock(loadLock);
+        done.swap(finishedLoads);
+    }
+
+    for (unsigned int ii = 0; ii < done.size(); ++ii) {
+        LoadJob& job = done[ii];
+        pendingLoads--;
+        bool loaded = false;
+
+        if (job.isTrack) {
+            // Only the newest play and queue requests count
+            if (job.chunk && job.ticket == (job.queued ? queueTicket : playTicket)) {
+                InstallTrack(job.chunk, job.queued, job.loop, job.fade);
+                loaded = true;
+            }
+            else {
+                Mix_FreeChunk(job.chunk);
+            }
+        }
+        else if (job.isMusic) {
+            // Only the newest music request counts
+            if (job.loadedMusic && job.ticket == musicTicket) {
+                UnloadMusic();
+                music = job.loadedMusic;
+                loaded = true;
+                if (job.play) {
+                    HookTracks(false);
+                    int played = Mix_PlayMusic(music, job.loop);
+                    assert(played != -1 && "Failed to play the new song during changeover");
+                }
+            }
+            else if (job.loadedMusic) {
+                Mix_FreeMusic(job.loadedMusic);
+            }
+        }
+        else {
+            // The slot could have been unloaded (and reused) or loaded synchronously meanwhile
+            int index = job.soundIndex;
+            bool current = ValidSoundIndex(index) && soundEffects[index].loading && soundEffects[index].ticket == job.ticket;
+            if (current && job.chunk) {
+                soundEffects[index].effect = job.chunk;
+                soundEffects[index].loading = false;
+                soundEffects[index].loadTicks = job.loadTicks;
+                CountResident(job.chunk, true);
+                loaded = true;
+            }
+            else if (current) {
+                // Couldn't load it, the index stops being valid
+                FreeSound(index);
+            }
+            else {
+                Mix_FreeChunk(job.chunk);
+                loaded = SoundReady(index) && soundEffects[index].ticket == job.ticket;
+            }
+
+            // Everyone who asked for it while it loaded
+            unordered_map<Uint32, vector<LoadWaiter> >::iterator waiting = loadWaiters.find(job.ticket);
+            if (waiting != loadWaiters.end()) {
+                vector<LoadWaiter> waiters;
+                waiters.swap(waiting->second);
+                loadWaiters.erase(waiting);
+                for (unsigned int jj = 0; jj < waiters.size(); ++jj) {
+                    waiters[jj].callback(index, loaded, waiters[jj].userData);
+                }
+            }
+        }
+
+        if (job.callback) {
+            job.callback(job.soundIndex, loaded, job.userData);
+        }
+    }
+}
+
+// Plays a track, crossfading over the current one
+void SDLAudio::PlayTrack(const char* fileName, int loop, int crossfadeMilliseconds) {
+    QueueTrackLoad(fileName, false, loop, crossfadeMilliseconds);
+}
+
+// Queues a track to follow the current one
+void SDLAudio::QueueTrack(const char* fileName, int loop, int crossfadeMilliseconds) {
+    QueueTrackLoad(fileName, true, loop, crossfadeMilliseconds);
+}
+
+// Hands a track to the loaders, tracks decode to a chunk like sound effects
+void SDLAudio::QueueTrackLoad(const char* fileName, bool queued, int loop, int fade) {
+    assert(fileName != nullptr && "Tried to load a track without a file name");
+    LoadJob job;
+    job.fileName = fileName;
+    job.soundIndex = -1;
+    job.ticket = ++nextTicket;
+    job.isMusic = false;
+    job.play = false;
+    job.loop = loop;
+    job.isTrack = true;
+    job.queued = queued;
+    job.fade = fade;
+    job.callback = nullptr;
+    job.userData = nullptr;
+    job.chunk = nullptr;
+    job.loadedMusic = nullptr;
+    job.loadTicks = 0;
+    job.cacheDirectory = soundCache;
+    if (queued) {
+        queueTicket = job.ticket;
+    }
+    else {
+        playTicket = job.ticket;
+    }
+    QueueLoad(job);
+}
+
+// Stops the tracks
+void SDLAudio::StopTrack(int milliseconds) {
+    // Anything still loading shouldn't start
+    playTicket = queueTicket = ++nextTicket;
+    if (!tracksHooked) {
+        return;
+    }
+
+    Uint32 fade = (Uint32)(milliseconds > 0 ? milliseconds : 0) * (Uint32)trackFrequency / 1000 * trackFrameSize;
+    SDL_AtomicLock(&trackLock);
+    for (int ii = 0; ii < TRACKVOICES; ++ii) {
+        TrackVoice& track = tracks[ii];
+        if (track.state == TRACK_WAITING || (track.state == TRACK_PLAYING && fade == 0)) {
+            track.state = TRACK_DONE;
+        }
+        else if (track.state == TRACK_PLAYING) {
+            track.state = TRACK_FADING;
+            track.fadeOut = fade;
+            track.fadeOutDone = 0;
+        }
+    }
+    SDL_AtomicUnlock(&trackLock);
+}
+
+// Returns true while a track is playing or queued
+bool SDLAudio::TrackPlaying() {
+    bool playing = false;
+    SDL_AtomicLock(&trackLock);
+    for (int ii = 0; ii < TRACKVOICES; ++ii) {
+        if (tracks[ii].state == TRACK_WAITING || tracks[ii].state == TRACK_PLAYING || tracks[ii].state == TRACK_FADING) {
+            playing = true;
+        }
+    }
+    SDL_AtomicUnlock(&trackLock);
+    return playing;
+}
+
+// Starts a loaded track, or queues it behind the current one
+void SDLAudio::InstallTrack(Mix_Chunk* chunk, bool queued, int loop, int fade) {
+    HookTracks(true);
+    Uint32 fadeBytes = (Uint32)(fade > 0 ? fade : 0) * (Uint32)trackFrequency / 1000 * trackFrameSize;
+    Mix_Chunk* cut = nullptr;
+
+    SDL_AtomicLock(&trackLock);
+    // Make way for it: a new queued track replaces the old one, a new playing one takes over
+    int slot = -1;
+    for (int ii = 0; ii < TRACKVOICES; ++ii) {
+        TrackVoice& track = tracks[ii];
+        if (queued && track.state == TRACK_WAITING) {
+            track.state = TRACK_DONE;
+        }
+        else if (!queued && track.state == TRACK_PLAYING) {
+            track.state = (fadeBytes > 0 ? TRACK_FADING : TRACK_DONE);
+            track.fadeOut = fadeBytes;
+            track.fadeOutDone = 0;
+        }
+    }
+    for (int ii = 0; ii < TRACKVOICES && slot == -1; ++ii) {
+        if (tracks[ii].state == TRACK_FREE) {
+            slot = ii;
+        }
+    }
+    // No free voice, cut off something already on its way out
+    for (int ii = 0; ii < TRACKVOICES && slot == -1; ++ii) {
+        if (tracks[ii].state == TRACK_DONE || tracks[ii].state == TRACK_FADING) {
+            slot = ii;
+            cut = tracks[ii].chunk;
+        }
+    }
+    assert(slot != -1 && "No track voice free");
+    TrackVoice& track = tracks[slot];
+    track.chunk = chunk;
+    track.state = (queued ? TRACK_WAITING : TRACK_PLAYING);
+    track.position = 0;
+    track.loops = loop;
+    track.fadeIn = fadeBytes;
+    track.fadeInDone = 0;
+    track.fadeOut = 0;
+    track.fadeOutDone = 0;
+    SDL_AtomicUnlock(&trackLock);
+
+    CountResident(chunk, true);
+    CountResident(cut, false);
+    Mix_FreeChunk(cut);
+}
+
+// Hooks the track player into the music stream, or unhooks it and frees the tracks
+void SDLAudio::HookTracks(bool on) {
+    if (on == tracksHooked) {
+        return;
+    }
+
+    if (on) {
+        Mix_HaltMusic();
+        int channels = 0;
+        Mix_QuerySpec(&trackFrequency, &trackFormat, &channels);
+        trackFrameSize = SDL_AUDIO_BITSIZE(trackFormat) / 8 * channels;
+        Mix_HookMusic(&TrackStream, this);
+        tracksHooked = true;
+    }
+    else {
+        // Once unhooked the audio thread can't be looking at them
+        Mix_HookMusic(nullptr, nullptr);
+        tracksHooked = false;
+        for (int ii = 0; ii < TRACKVOICES; ++ii) {
+            CountResident(tracks[ii].chunk, false);
+            Mix_FreeChunk(tracks[ii].chunk);
+            tracks[ii].chunk = nullptr;
+            tracks[ii].state = TRACK_FREE;
+        }
+    }
+}
+
+// Frees tracks the audio thread has finished with
+void SDLAudio::ReleaseTracks() {
+    Mix_Chunk* finished[TRACKVOICES];
+    int count = 0;
+    SDL_AtomicLock(&trackLock);
+    for (int ii = 0; ii < TRACKVOICES; ++ii) {
+        if (tracks[ii].state == TRACK_DONE) {
+            finished[count++] = tracks[ii].chunk;
+            tracks[ii].chunk = nullptr;
+            tracks[ii].state = TRACK_FREE;
+        }
+    }
+    SDL_AtomicUnlock(&trackLock);
+
+    for (int ii = 0; ii < count; ++ii) {
+        CountResident(finished[ii], false);
+        Mix_FreeChunk(finished[ii]);
+    }
+}
+
+// Fills the music stream with tracks, on the audio thread
+void TrackStream(void* userData, Uint8* stream, int length) {
+    SDLAudio* owner = (SDLAudio*)userData;
+    // Music is mixed first in every callback, so this is when mixing started
+    owner->mixStart = SDL_GetPerformanceCounter();
+    SDL_AtomicLock(&owner->trackLock);
+    owner->MixTracks(stream, length);
+    SDL_AtomicUnlock(&owner->trackLock);
+}
+
+// Mixes every track into the stream. A queued track starts at the exact
+// byte where the current one reaches its crossfade point (or its end).
+void SDLAudio::MixTracks(Uint8* stream, int length) {
+    // Tracks on their way out just carry on
+    int lead = -1;
+    int waiting = -1;
+    for (int ii = 0; ii < TRACKVOICES; ++ii) {
+        if (tracks[ii].state == TRACK_FADING) {
+            MixTrack(tracks[ii], stream, length);
+        }
+        else if (tracks[ii].state == TRACK_PLAYING && lead == -1) {
+            lead = ii;
+        }
+        else if (tracks[ii].state == TRACK_WAITING && waiting == -1) {
+            waiting = ii;
+        }
+    }
+
+    // Nothing playing, a queued track can start right away
+    if (lead == -1 && waiting != -1) {
+        tracks[waiting].state = TRACK_PLAYING;
+        lead = waiting;
+        waiting = -1;
+    }
+    if (lead == -1) {
+        return;
+    }
+
+    // Where in this buffer the queued track comes in
+    TrackVoice& current = tracks[lead];
+    Uint32 startAt = (Uint32)length;
+    if (waiting != -1 && current.loops == 0 && current.chunk->alen >= current.position) {
+        Uint32 remaining = current.chunk->alen - current.position;
+        Uint32 overlap = tracks[waiting].fadeIn;
+        Uint32 trigger = (remaining > overlap ? remaining - overlap : 0);
+        trigger -= trigger % trackFrameSize;
+        if (trigger < startAt) {
+            startAt = trigger;
+        }
+    }
+
+    MixTrack(current, stream, startAt);
+    if (startAt < (Uint32)length) {
+        // The current track fades out over whatever is left of it
+        if (current.state == TRACK_PLAYING) {
+            current.fadeOut = current.chunk->alen - current.position;
+            current.fadeOutDone = 0;
+            current.state = (current.fadeOut > 0 ? TRACK_FADING : TRACK_DONE);
+        }
+        TrackVoice& next = tracks[waiting];
+        next.state = TRACK_PLAYING;
+        MixTrack(current, stream + startAt, length - startAt);
+        MixTrack(next, stream + startAt, length - startAt);
+    }
+}
+
+// Mixes one track into the stream, stepping its fades every TRACKBLOCK frames
+void SDLAudio::MixTrack(TrackVoice& track, Uint8* stream, Uint32 length) {
+    if (track.chunk == nullptr || track.chunk->alen < trackFrameSize) {
+        track.state = TRACK_DONE;
+        return;
+    }
+
+    Uint32 block = TRACKBLOCK * trackFrameSize;
+    int volume = trackVolume.load();
+    while (length > 0 && (track.state == TRACK_PLAYING || track.state == TRACK_FADING)) {
+        Uint32 count = length;
+        if (count > block) {
+            count = block;
+        }
+        if (count > track.chunk->alen - track.position) {
+            count = track.chunk->alen - track.position;
+        }
+
+        float gain = 1.0f;
+        if (track.fadeInDone < track.fadeIn) {
+            gain = (float)track.fadeInDone / track.fadeIn;
+            track.fadeInDone += count;
+        }
+        if (track.state == TRACK_FADING) {
+            gain *= 1.0f - (track.fadeOutDone < track.fadeOut ? (float)track.fadeOutDone / track.fadeOut : 1.0f);
+            track.fadeOutDone += count;
+        }
+        int blockVolume = (int)(volume * gain);
+        if (blockVolume > 0) {
+            SDL_MixAudioFormat(stream, track.chunk->abuf + track.position, trackFormat, count, blockVolume);
+        }
+        track.position += count;
+        stream += count;
+        length -= count;
+
+        // Faded all the way out
+        if (track.state == TRACK_FADING && track.fadeOutDone >= track.fadeOut) {
+            track.state = TRACK_DONE;
+        }
+        // Reached the end, loop or finish
+        else if (track.position >= track.chunk->alen) {
+            if (track.loops != 0) {
+                track.position = 0;
+                if (track.loops > 0) {
+                    track.loops--;
+                }
+            }
+            else {
+                track.state = TRACK_DONE;
+            }
+        }
+    }
+}
+
+// Sets where the listener is
+void SDLAudio::Listener(float x, float y) {
+    listenerX = x;
+    listenerY = y;
+}
+
+// Sets how positioned sounds fall off
+void SDLAudio::Falloff(float minDistance, float maxDistance, float panWidth) {
+    assert(minDistance >= 0.0f && maxDistance > minDistance && panWidth > 0.0f && "Invalid falloff");
+    falloffMin = minDistance;
+    falloffMax = maxDistance;
+    this->panWidth = panWidth;
+}
+
+// The positional effect only handles stereo 16 bit or float output
+bool SDLAudio::PositionalFormat() const {
+    return mixChannels == 2 && (mixFormat == AUDIO_S16SYS || mixFormat == AUDIO_F32SYS);
+}
+
+// Works out one emitter's gains, packed the way the audio thread reads them
+Uint32 SDLAudio::PackedGains(float x, float y) const {
+    float dx = x - listenerX;
+    float dy = y - listenerY;
+    float distance = SDL_sqrtf(dx * dx + dy * dy);
+    float attenuation = 1.0f - (distance - falloffMin) / (falloffMax - falloffMin);
+    attenuation = (attenuation < 0.0f ? 0.0f : (attenuation > 1.0f ? 1.0f : attenuation));
+    float pan = dx / panWidth;
+    pan = (pan < -1.0f ? -1.0f : (pan > 1.0f ? 1.0f : pan));
+    float left = attenuation * (pan > 0.0f ? 1.0f - pan : 1.0f);
+    float right = attenuation * (pan < 0.0f ? 1.0f + pan : 1.0f);
+    return ((Uint32)(left * 32767.0f + 0.5f) << 16) | (Uint32)(right * 32767.0f + 0.5f);
+}
+
+// Positions a playing sound
+void SDLAudio::PositionSound(int channel, float x, float y) {
+    if (!PositionalFormat() || ChannelOwner(channel) == NOOWNER) {
+        return;
+    }
+    emitterX[channel] = x;
+    emitterY[channel] = y;
+
+    // First time, get the gains right before the effect ever runs
+    if (!positioned[channel]) {
+        channelGains[channel].store(PackedGains(x, y), std::memory_order_relaxed);
+        positioned[channel] = true;
+        Mix_RegisterEffect(channel, &PositionEffect, nullptr, this);
+    }
+}
+
+// Works out the gains of every positioned sound in one pass
+void SDLAudio::UpdatePositions() {
+    if (!PositionalFormat()) {
+        return;
+    }
+    int count = (channelCount + 3) & ~3;
+
+#ifdef SDLAUDIO_SSE2
+    // Four channels at a time
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    const __m128 listenX = _mm_set1_ps(listenerX);
+    const __m128 listenY = _mm_set1_ps(listenerY);
+    const __m128 nearest = _mm_set1_ps(falloffMin);
+    const __m128 overRange = _mm_set1_ps(1.0f / (falloffMax - falloffMin));
+    const __m128 overPan = _mm_set1_ps(1.0f / panWidth);
+    for (int ii = 0; ii < count; ii += 4) {
+        __m128 dx = _mm_sub_ps(_mm_load_ps(emitterX + ii), listenX);
+        __m128 dy = _mm_sub_ps(_mm_load_ps(emitterY + ii), listenY);
+        __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+        __m128 attenuation = _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(distance, nearest), overRange));
+        attenuation = _mm_min_ps(_mm_max_ps(attenuation, zero), one);
+        __m128 pan = _mm_min_ps(_mm_max_ps(_mm_mul_ps(dx, overPan), minusOne), one);
+        __m128 left = _mm_mul_ps(attenuation, _mm_min_ps(_mm_sub_ps(one, pan), one));
+        __m128 right = _mm_mul_ps(attenuation, _mm_min_ps(_mm_add_ps(one, pan), one));
+        _mm_store_si128((__m128i*)(leftGains + ii), _mm_cvtps_epi32(_mm_mul_ps(left, scale)));
+        _mm_store_si128((__m128i*)(rightGains + ii), _mm_cvtps_epi32(_mm_mul_ps(right, scale)));
+    }
+    for (int ii = 0; ii < channelCount; ++ii) {
+        if (positioned[ii]) {
+            channelGains[ii].store(((Uint32)leftGains[ii] << 16) | (Uint32)rightGains[ii], std::memory_order_relaxed);
+        }
+    }
+#else
+    for (int ii = 0; ii < channelCount; ++ii) {
+        if (positioned[ii]) {
+            channelGains[ii].store(PackedGains(emitterX[ii], emitterY[ii]), std::memory_order_relaxed);
+        }
+    }
+#endif
+}
+
+// Scales interleaved stereo 16 bit samples, gains are 0 to 32767
+static void GainS16(Sint16* samples, int count, Sint16 left, Sint16 right) {
+    int ii = 0;
+#ifdef SDLAUDIO_SSE2
+    // mulhi keeps the top 16 bits of each product, the shift makes up for the gain being Q15
+    const __m128i gains = _mm_set_epi16(right, left, right, left, right, left, right, left);
+    for (; ii + 8 <= count; ii += 8) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(samples + ii));
+        block = _mm_slli_epi16(_mm_mulhi_epi16(block, gains), 1);
+        _mm_storeu_si128((__m128i*)(samples + ii), block);
+    }
+#endif
+    for (; ii + 1 < count; ii += 2) {
+        samples[ii] = (Sint16)((samples[ii] * left) >> 15);
+        samples[ii + 1] = (Sint16)((samples[ii + 1] * right) >> 15);
+    }
+}
+
+// Scales interleaved stereo float samples
+static void GainF32(float* samples, int count, float left, float right) {
+    int ii = 0;
+#ifdef SDLAUDIO_SSE2
+    const __m128 gains = _mm_set_ps(right, left, right, left);
+    for (; ii + 4 <= count; ii += 4) {
+        _mm_storeu_ps(samples + ii, _mm_mul_ps(_mm_loadu_ps(samples + ii), gains));
+    }
+#endif
+    for (; ii + 1 < count; ii += 2) {
+        samples[ii] *= left;
+        samples[ii + 1] *= right;
+    }
+}
+
+// Pans and attenuates a positioned channel on the audio thread, before SDL_mixer adds it to the mix
+void PositionEffect(int channel, void* stream, int length, void* userData) {
+    SDLAudio* owner = (SDLAudio*)userData;
+    Uint32 gains = owner->channelGains[channel].load(std::memory_order_relaxed);
+    Sint16 left = (Sint16)(gains >> 16);
+    Sint16 right = (Sint16)(gains & 0xFFFF);
+    if (owner->mixFormat == AUDIO_S16SYS) {
+        GainS16((Sint16*)stream, length / 2, left, right);
+    }
+    else {
+        GainF32((float*)stream, length / 4, left / 32767.0f, right / 32767.0f);
+    }
+}
+
+// Sound banks are:
+//   "SDLB", Uint32 version, Uint32 frequency, Uint16 format, Uint16 channels, Uint32 sound count
+//   per sound: Uint64 sample offset, Uint32 sample bytes, Uint32 name length
+//   the names, back to back
+//   the samples, each starting on a BANKALIGNMENT byte boundary
+// All little endian. The samples are exactly what the mixer plays, so loading is just mapping.
+static const char bankMagic[4] = { 'S', 'D', 'L', 'B' };
+static const Uint32 bankVersion = 1;
+static const Uint32 bankHeaderSize = 20;
+static const Uint32 bankEntrySize = 16;
+
+// Packs sounds into a bank file
+bool SDLAudio::PackSoundBank(const char* bankName, const char* const* fileNames, int count) {
+    int frequency = 0;
+    Uint16 format = 0;
+    int channels = 0;
+    int opened = Mix_QuerySpec(&frequency, &format, &channels);
+    assert(opened != 0 && "Open the audio before packing a sound bank");
+    if (!opened) {
+        return false;
+    }
+
+    // Decode everything first, Mix_LoadWAV converts to the mixer's format
+    vector<Mix_Chunk*> chunks;
+    vector<string> names;
+    for (int ii = 0; ii < count; ++ii) {
+        Mix_Chunk* chunk = Mix_LoadWAV_RW(SDLArchive::Instance()->Open(fileNames[ii]), 1);
+        if (!chunk) {
+            for (unsigned int jj = 0; jj < chunks.size(); ++jj) {
+                Mix_FreeChunk(chunks[jj]);
+            }
+            return false;
+        }
+        chunks.push_back(chunk);
+        names.push_back(SoundKey(fileNames[ii]));
+    }
+
+    // Work out where the samples go
+    Uint64 offset = bankHeaderSize + (Uint64)bankEntrySize * count;
+    for (int ii = 0; ii < count; ++ii) {
+        offset += names[ii].size();
+    }
+    vector<Uint64> offsets;
+    for (int ii = 0; ii < count; ++ii) {
+        offset = (offset + BANKALIGNMENT - 1) & ~(Uint64)(BANKALIGNMENT - 1);
+        offsets.push_back(offset);
+        offset += chunks[ii]->alen;
+    }
+
+    SDL_RWops* file = SDL_RWFromFile(bankName, "wb");
+    bool written = (file != nullptr);
+    if (file) {
+        // Header
+        written = SDL_RWwrite(file, bankMagic, 1, 4) == 4 && SDL_WriteLE32(file, bankVersion) == 1
+            && SDL_WriteLE32(file, (Uint32)frequency) == 1 && SDL_WriteLE16(file, format) == 1
+            && SDL_WriteLE16(file, (Uint16)channels) == 1 && SDL_WriteLE32(file, (Uint32)count) == 1;
+
+        // Table
+        for (int ii = 0; ii < count && written; ++ii) {
+            written = SDL_WriteLE64(file, offsets[ii]) == 1 && SDL_WriteLE32(file, chunks[ii]->alen) == 1
+                && SDL_WriteLE32(file, (Uint32)names[ii].size()) == 1;
+        }
+        for (int ii = 0; ii < count && written; ++ii) {
+            written = SDL_RWwrite(file, names[ii].c_str(), 1, names[ii].size()) == names[ii].size();
+        }
+
+        // Samples
+        const Uint8 padding[BANKALIGNMENT] = { 0 };
+        for (int ii = 0; ii < count && written; ++ii) {
+            Sint64 position = SDL_RWtell(file);
+            size_t pad = (size_t)(offsets[ii] - position);
+            written = position >= 0 && (Uint64)position <= offsets[ii]
+                && (pad == 0 || SDL_RWwrite(file, padding, 1, pad) == pad)
+                && SDL_RWwrite(file, chunks[ii]->abuf, 1, chunks[ii]->alen) == chunks[ii]->alen;
+        }
+        written = (SDL_RWclose(file) == 0) && written;
+
+        // Don't leave a broken bank behind for LoadSoundBank to trip over
+        if (!written) {
+            remove(bankName);
+        }
+    }
+
+    for (unsigned int ii = 0; ii < chunks.size(); ++ii) {
+        Mix_FreeChunk(chunks[ii]);
+    }
+    return written;
+}
+
+// Reads little endian values out of the mapping
+static Uint16 BankRead16(const Uint8* data) {
+    Uint16 value;
+    memcpy(&value, data, sizeof(value));
+    return SDL_SwapLE16(value);
+}
+static Uint32 BankRead32(const Uint8* data) {
+    Uint32 value;
+    memcpy(&value, data, sizeof(value));
+    return SDL_SwapLE32(value);
+}
+static Uint64 BankRead64(const Uint8* data) {
+    Uint64 value;
+    memcpy(&value, data, sizeof(value));
+    return SDL_SwapLE64(value);
+}
+
+// Maps a bank and makes every sound in it
+int SDLAudio::LoadSoundBank(const char* bankName) {
+    MappedFile* file = new MappedFile();
+    if (!file->Open(bankName)) {
+        delete file;
+        return -1;
+    }
+    const Uint8* data = file->Data();
+    size_t size = file->Size();
+
+    // One of ours, made for this mixer format?
+    int frequency = 0;
+    Uint16 format = 0;
+    int channels = 0;
+    Mix_QuerySpec(&frequency, &format, &channels);
+    if (size < bankHeaderSize || memcmp(data, bankMagic, 4) != 0 || BankRead32(data + 4) != bankVersion
+        || BankRead32(data + 8) != (Uint32)frequency || BankRead16(data + 12) != format
+        || BankRead16(data + 14) != (Uint16)channels) {
+        delete file;
+        return -1;
+    }
+    Uint32 count = BankRead32(data + 16);
+    if ((size - bankHeaderSize) / bankEntrySize < count) {
+        delete file;
+        return -1;
+    }
+
+    // Check the whole table before making anything
+    const Uint8* table = data + bankHeaderSize;
+    Uint64 nameOffset = bankHeaderSize + (Uint64)bankEntrySize * count;
+    for (Uint32 ii = 0; ii < count; ++ii) {
+        Uint64 offset = BankRead64(table + ii * bankEntrySize);
+        Uint32 length = BankRead32(table + ii * bankEntrySize + 8);
+        nameOffset += BankRead32(table + ii * bankEntrySize + 12);
+        if (nameOffset > size || offset > size || length > size - offset) {
+            delete file;
+            return -1;
+        }
+    }
+
+    // Every chunk points straight into the mapping
+    SoundBank bank;
+    bank.file = file;
+    int bankIndex = (int)soundBanks.size();
+    const char* name = (const char*)(data + bankHeaderSize + bankEntrySize * count);
+    for (Uint32 ii = 0; ii < count; ++ii) {
+        Uint64 offset = BankRead64(table + ii * bankEntrySize);
+        Uint32 length = BankRead32(table + ii * bankEntrySize + 8);
+        Uint32 nameLength = BankRead32(table + ii * bankEntrySize + 12);
+        string key(name, nameLength);
+        name += nameLength;
+
+        // Something with the same name is already loaded, keep that one
+        if (soundLookup.find(key) != soundLookup.end()) {
+            continue;
+        }
+        Mix_Chunk* chunk = Mix_QuickLoad_RAW((Uint8*)(data + offset), length);
+        assert(chunk != nullptr && "Failed to make a Sound Effect from a bank");
+        int index = AddSound(chunk, key);
+        soundEffects[index].bank = bankIndex;
+        bank.sounds.push_back(index);
+    }
+    soundBanks.push_back(bank);
+    Count(mappedBytes, size);
+    return bankIndex;
+}
+
+// Unloads every sound in a bank and unmaps it
+void SDLAudio::UnloadSoundBank(int bankIndex) {
+    if (bankIndex < 0 || bankIndex >= (int)soundBanks.size() || !soundBanks[bankIndex].file) {
+        return;
+    }
+    SoundBank& bank = soundBanks[bankIndex];
+    for (unsigned int ii = 0; ii < bank.sounds.size(); ++ii) {
+        int index = bank.sounds[ii];
+        if (ValidSoundIndex(index) && soundEffects[index].bank == bankIndex) {
+            FreeSound(index);
+        }
+    }
+    bank.sounds.clear();
+
+    // Nothing points into it now
+    mappedBytes.fetch_sub(bank.file->Size(), std::memory_order_relaxed);
+    delete bank.file;
+    bank.file = nullptr;
+}
+
+// Cached sounds are:
+//   "SDLC", Uint32 version, Uint32 frequency, Uint16 format, Uint16 channels,
+//   Uint64 source hash, Uint32 sample bytes, Uint32 unused
+//   the samples, exactly what the mixer plays
+// All little endian, like the banks.
+static const char cacheMagic[4] = { 'S', 'D', 'L', 'C' };
+static const Uint32 cacheVersion = 1;
+static const Uint32 cacheHeaderSize = 32;
+
+// Wraps samples from SDL_malloc in a chunk Mix_FreeChunk will clean up
+static Mix_Chunk* OwnedChunk(Uint8* samples, Uint32 length) {
+    Mix_Chunk* chunk = (Mix_Chunk*)SDL_malloc(sizeof(Mix_Chunk));
+    if (!chunk) {
+        SDL_free(samples);
+        return nullptr;
+    }
+    chunk->allocated = 1;
+    chunk->abuf = samples;
+    chunk->alen = length;
+    chunk->volume = MIX_MAX_VOLUME;
+    return chunk;
+}
+
+// Keeps converted sounds in a directory
+void SDLAudio::SoundCache(const char* directory) {
+    soundCache = (directory ? directory : "");
+    // Leave the joining slash to DecodeSound
+    while (!soundCache.empty() && (soundCache.back() == '/' || soundCache.back() == '\\')) {
+        soundCache.pop_back();
+    }
+}
+
+// Decodes a sound file held in memory and converts it to the mixer's format
+Mix_Chunk* SDLAudio::ConvertSound(const Uint8* data, size_t size) {
+    // WAVs go through an audio stream, which resamples as SDL_HINT_AUDIO_RESAMPLING_MODE says.
+    // Everything else is converted by SDL_mixer with SDL_AudioCVT's own resampler.
+    SDL_AudioSpec spec;
+    Uint8* samples = nullptr;
+    Uint32 length = 0;
+    if (SDL_LoadWAV_RW(SDL_RWFromConstMem(data, (int)size), 1, &spec, &samples, &length)) {
+        SDL_AudioStream* stream = SDL_NewAudioStream(spec.format, spec.channels, spec.freq,
+            mixFormat, (Uint8)mixChannels, mixFrequency);
+        Uint8* converted = nullptr;
+        int available = 0;
+        if (stream && SDL_AudioStreamPut(stream, samples, (int)length) == 0 && SDL_AudioStreamFlush(stream) == 0) {
+            available = SDL_AudioStreamAvailable(stream);
+            converted = (Uint8*)SDL_malloc(available > 0 ? available : 1);
+            if (converted) {
+                available = SDL_AudioStreamGet(stream, converted, available);
+            }
+        }
+        if (stream) {
+            SDL_FreeAudioStream(stream);
+        }
+        SDL_FreeWAV(samples);
+        if (!converted || available < 0) {
+            SDL_free(converted);
+            return nullptr;
+        }
+        return OwnedChunk(converted, (Uint32)available);
+    }
+
+    // Everything else is left to SDL_mixer's decoders
+    return Mix_LoadWAV_RW(SDL_RWFromConstMem(data, (int)size), 1);
+}
+
+// Reads a converted sound back, returns nullptr if it isn't there or doesn't match
+Mix_Chunk* SDLAudio::ReadCachedSound(const string& cacheName, Uint64 sourceHash) {
+    MappedFile file;
+    if (!file.Open(cacheName.c_str()) || file.Size() < cacheHeaderSize) {
+        return nullptr;
+    }
+    const Uint8* data = file.Data();
+    Uint32 length = BankRead32(data + 24);
+    if (memcmp(data, cacheMagic, 4) != 0 || BankRead32(data + 4) != cacheVersion
+        || BankRead32(data + 8) != (Uint32)mixFrequency || BankRead16(data + 12) != mixFormat
+        || BankRead16(data + 14) != (Uint16)mixChannels || BankRead64(data + 16) != sourceHash
+        || file.Size() - cacheHeaderSize != length) {
+        return nullptr;
+    }
+    Uint8* samples = (Uint8*)SDL_malloc(length > 0 ? length : 1);
+    if (!samples) {
+        return nullptr;
+    }
+    memcpy(samples, data + cacheHeaderSize, length);
+    return OwnedChunk(samples, length);
+}
+
+// Writes a converted sound out for next time. Written under a temporary name and renamed,
+// so a crash or another loader never leaves half a file where a reader would find it.
+void SDLAudio::WriteCachedSound(const string& cacheName, Uint64 sourceHash, Mix_Chunk* chunk) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%lu.tmp", (unsigned long)SDL_ThreadID());
+    string temporaryName = cacheName + suffix;
+    SDL_RWops* file = SDL_RWFromFile(temporaryName.c_str(), "wb");
+    if (!file) {
+        return;
+    }
+    bool written = SDL_RWwrite(file, cacheMagic, 1, 4) == 4 && SDL_WriteLE32(file, cacheVersion) == 1
+        && SDL_WriteLE32(file, (Uint32)mixFrequency) == 1 && SDL_WriteLE16(file, mixFormat) == 1
+        && SDL_WriteLE16(file, (Uint16)mixChannels) == 1 && SDL_WriteLE64(file, sourceHash) == 1
+        && SDL_WriteLE32(file, chunk->alen) == 1 && SDL_WriteLE32(file, 0) == 1
+        && SDL_RWwrite(file, chunk->abuf, 1, chunk->alen) == chunk->alen;
+    written = (SDL_RWclose(file) == 0) && written;
+    if (!written || rename(temporaryName.c_str(), cacheName.c_str()) != 0) {
+        // Another loader may have beaten us to it, either way this copy isn't needed
+        remove(temporaryName.c_str());
+    }
+}
+
+// Plays a sound effect
+int SDLAudio::PlaySoundEffect(int soundIndex, int loop) {
+    return StartSound(soundIndex, loop, 0, false);
+}
+
+// This function is called when a SoundEffect is finished playing. It runs on the audio thread
+// (or inside Mix_HaltChannel), so it only clears the channel's owner: no locks, allocation or I/O.
+void ChannelFinished(int channel) {
+    if (channel < 0 || channel >= MAXCHANNELS) {
+        return;
+    }
+    SDLAudio* sounds = SDLAudio::Instance();
+    // SDL_mixer removes the channel's effects right after this
+    sounds->positioned[channel] = false;
+    sounds->ReleaseChannel(channel);
+}
+
+// Stop sound
+void SDLAudio::StopSoundEffect(int soundIndex, int channel) {
+    // Don't bother if it's a bad index, or the channel is playing something else now
+    if (ValidSoundIndex(soundIndex) && ChannelOwner(channel) == soundIndex) {
+        Mix_HaltChannel(channel);
+        // Callback gets called automatically
+    }
+}
+
+// Fade in sound
+int SDLAudio::FadeInSoundEffect(int soundIndex, int milliseconds, int loop) {
+    return StartSound(soundIndex, loop, milliseconds, true);
+}
+
+// Actually starts the sound effect. This function is shared between Play and FadeIn
+int SDLAudio::StartSound(int soundIndex, int loop, int milliseconds, bool fade) {
+    // Only bother if given a valid index
+    if (!ValidSoundIndex(soundIndex)) {
+        return -1;
+    }
+    SoundEffect& sound = soundEffects[soundIndex];
+
+    // Retriggered too soon, skip it
+    Uint32 now = SDL_GetTicks();
+    if (sound.minInterval > 0 && sound.lastPlayed != 0 && now - sound.lastPlayed < sound.minInterval) {
+        Count(dropCount);
+        return -1;
+    }
+
+    // Still loading
+    if (!sound.effect) {
+        return -1;
+    }
+
+    // If there are no voices left (and nothing to steal), it will not play. This is okay.
+    int channel = ClaimChannel(soundIndex);
+    if (channel == -1) {
+        Count(dropCount);
+        return -1;
+    }
+
+    // Start at its bus's volume
+    ApplyBuses();
+    channelBus[channel] = sound.bus;
+    channelVolume[channel] = BusChannelVolume(sound.bus);
+    Mix_Volume(channel, channelVolume[channel]);
+
+    // A position left over from something else on this channel
+    if (positioned[channel].exchange(false)) {
+        Mix_UnregisterEffect(channel, &PositionEffect);
+    }
+
+    int played = -1;
+    if (!fade) {
+        played = Mix_PlayChannel(channel, sound.effect, loop);
+    }
+    else {
+        played = Mix_FadeInChannel(channel, sound.effect, loop, milliseconds);
+    }
+    // Any other reason though,... freak out
+    if (played == -1) {
+        ReleaseChannel(channel);
+        assert(played != -1 && "An error occurred while attempting to play a sound effect");
+        return -1;
+    }
+
+    // Keep track
+    sound.lastPlayed = now;
+    channelStarted[channel] = now;
+    Count(playCount);
+    int active = soundCount.load(std::memory_order_relaxed);
+    if (active > peakVoices.load(std::memory_order_relaxed)) {
+        peakVoices.store(active, std::memory_order_relaxed);
+    }
+    return channel;
+}
+
+// Finds a voice for a sound. Takes a free one if there is one, otherwise steals the quietest,
+// then oldest, voice of the lowest priority below this sound's. Returns -1 if the sound is dropped.
+int SDLAudio::ClaimChannel(int soundIndex) {
+    const SoundEffect& sound = soundEffects[soundIndex];
+    int freeChannel = -1;
+    int instances = 0;
+    int victim = -1;
+    int victimPriority = 0;
+    int victimVolume = 0;
+
+    for (int ii = 0; ii < channelCount; ++ii) {
+        int owner = channelOwner[ii].load();
+        if (owner == NOOWNER) {
+            if (freeChannel == -1) {
+                freeChannel = ii;
+            }
+            continue;
+        }
+        if (owner == soundIndex) {
+            ++instances;
+        }
+
+        // Only lower priority voices can be stolen
+        if (!ValidSoundIndex(owner) || soundEffects[owner].priority >= sound.priority) {
+            continue;
+        }
+        int priority = soundEffects[owner].priority;
+        int volume = Mix_Volume(ii, -1) * Mix_VolumeChunk(soundEffects[owner].effect, -1);
+        if (victim == -1 || priority < victimPriority
+            || (priority == victimPriority && (volume < victimVolume
+            || (volume == victimVolume && (Sint32)(channelStarted[ii] - channelStarted[victim]) < 0)))) {
+            victim = ii;
+            victimPriority = priority;
+            victimVolume = volume;
+        }
+    }
+
+    // Enough copies playing already
+    if (sound.maxInstances > 0 && instances >= sound.maxInstances) {
+        return -1;
+    }
+
+    if (freeChannel != -1 && TryClaimChannel(freeChannel, soundIndex)) {
+        return freeChannel;
+    }
+
+    // Halting calls ChannelFinished right away, which frees the channel
+    if (victim != -1) {
+        Mix_HaltChannel(victim);
+        Count(stealCount);
+        if (TryClaimChannel(victim, soundIndex)) {
+            return victim;
+        }
+    }
+    Count(noChannelCount);
+    return -1;
+}
+
+// Takes a channel if it's free. The owner is recorded before the sound starts,
+// so ChannelFinished can never run first and leave a stale owner behind.
+bool SDLAudio::TryClaimChannel(int channel, int soundIndex) {
+    int expected = NOOWNER;
+    if (channelOwner[channel].compare_exchange_strong(expected, soundIndex)) {
+        ++soundCount;
+        return true;
+    }
+    return false;
+}
+
+// Gives back a channel that was claimed but never started
+void SDLAudio::ReleaseChannel(int channel) {
+    if (channelOwner[channel].exchange(NOOWNER) != NOOWNER) {
+        soundCount--;
+    }
+}
+
+// Sets how many sounds can play at once
+void SDLAudio::Voices(int count) {
+    assert(count > 0 && count <= MAXCHANNELS && "Voice count must be between 1 and MAXCHANNELS");
+    // Shrinking halts the channels that go away, which frees them in the table
+    channelCount = Mix_AllocateChannels(count);
+}
+
+// Sets a sound's voice rules
+void SDLAudio::SoundVoiceRules(int soundIndex, int priority, int maxInstances, Uint32 minInterval) {
+    if (ValidSoundIndex(soundIndex)) {
+        soundEffects[soundIndex].priority = priority;
+        soundEffects[soundIndex].maxInstances = maxInstances;
+        soundEffects[soundIndex].minInterval = minInterval;
+    }
+}
+
+// Zeroes the played, dropped and stolen counts
+void SDLAudio::ResetSoundStats() {
+    playCount = 0;
+    dropCount = 0;
+    stealCount = 0;
+}
+
+// Played, dropped and stolen counts
+SDLAudio::VoiceStats SDLAudio::SoundStats() const {
+    VoiceStats stats;
+    stats.played = (int)playCount.load(std::memory_order_relaxed);
+    stats.dropped = (int)dropCount.load(std::memory_order_relaxed);
+    stats.stolen = (int)stealCount.load(std::memory_order_relaxed);
+    return stats;
+}
+
+// Voices, plays, failures, loads, memory and mixer time
+SDLAudio::AudioCounters SDLAudio::Counters() const {
+    AudioCounters counters;
+    counters.activeVoices = soundCount.load(std::memory_order_relaxed);
+    counters.peakVoices = peakVoices.load(std::memory_order_relaxed);
+    counters.plays = playCount.load(std::memory_order_relaxed);
+    counters.noFreeChannel = noChannelCount.load(std::memory_order_relaxed);
+    counters.dropped = dropCount.load(std::memory_order_relaxed);
+    counters.stolen = stealCount.load(std::memory_order_relaxed);
+    counters.loads = loadCount.load(std::memory_order_relaxed);
+    counters.loadMs = loadTicks.load(std::memory_order_relaxed) * 1000.0 / SDL_GetPerformanceFrequency();
+    counters.residentBytes = residentBytes.load(std::memory_order_relaxed);
+    counters.mappedBytes = mappedBytes.load(std::memory_order_relaxed);
+    AudioTiming timing = Timing();
+    counters.averageMixMs = timing.averageMixMs;
+    counters.maxMixMs = timing.maxMixMs;
+    return counters;
+}
+
+// Zeroes the counters
+void SDLAudio::ResetCounters() {
+    ResetSoundStats();
+    noChannelCount = 0;
+    loadCount = 0;
+    loadTicks = 0;
+    peakVoices = soundCount.load();
+}
+
+// How long a sound took to decode
+double SDLAudio::SoundLoadMs(int soundIndex) const {
+    if (!ValidSoundIndex(soundIndex)) {
+        return 0.0;
+    }
+    return soundEffects[soundIndex].loadTicks * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Fade out sound
+void SDLAudio::FadeOutSoundEffect(int soundIndex, int channel, int milliseconds) {
+    // Don't bother if the index is bad
+    if (ValidSoundIndex(soundIndex)) {
+        Mix_FadeOutChannel(channel, milliseconds);
+    }
+}
+
+// Pause sound
+void SDLAudio::PauseSoundEffect(int soundIndex, int channel) {
+    if (ValidSoundIndex(soundIndex)) {
+        Mix_Pause(channel);
+    }
+}
+
+// Mute sound
+void SDLAudio::MuteSoundEffects() {
+    SoundEffectsVolume(0);
+}
+
+// Set the sound effects volume, 0 = mute, 128 = max
+void SDLAudio::SoundEffectsVolume(int newVolume) {
+    effectsVolume = (newVolume < 0 ? 0 : (newVolume > MIX_MAX_VOLUME ? MIX_MAX_VOLUME : newVolume));
+    busesDirty = true;
+    // Callers expect this to be heard straight away, not on the next Update
+    ApplyBuses();
+}
+
+// Get the sound effects volume
+int SDLAudio::SoundEffectsVolume() {
+    return effectsVolume;
+}
+
+// Mute sound & music
+void SDLAudio::Mute() {
+    MuteMusic();
+    MuteSoundEffects();
+}
+
+// Sets up the standard buses at full volume
+void SDLAudio::ResetBuses() {
+    busCount = 0;
+    effectsVolume = MIX_MAX_VOLUME;
+    AddBus("sfx");
+    AddBus("ui");
+    AddBus("voice");
+    AddBus("ambient");
+    for (int ii = 0; ii < MAXCHANNELS; ++ii) {
+        channelBus[ii] = BUS_SFX;
+        channelVolume[ii] = MIX_MAX_VOLUME;
+    }
+    lastBusUpdate = SDL_GetTicks();
+    busesDirty = true;
+    fadesPending = false;
+}
+
+// Adds a bus
+int SDLAudio::AddBus(const char* name, int parent) {
+    assert(name != nullptr && "Buses need a name");
+    // Parents have to exist first, so working gains out in order always has the parent's ready
+    assert(parent >= NOBUS && parent < busCount && "A bus's parent has to be added before it");
+    if (busCount == MAXBUSES) {
+        return NOBUS;
+    }
+    Bus& bus = buses[busCount];
+    bus.name = name;
+    bus.parent = parent;
+    bus.volume = MIX_MAX_VOLUME;
+    bus.muted = false;
+    bus.duckTrigger = NOBUS;
+    bus.duckVolume = MIX_MAX_VOLUME;
+    bus.duckTime = 0;
+    bus.duckLevel = 1.0f;
+    bus.gain = 1.0f;
+    busesDirty = true;
+    return busCount++;
+}
+
+// Finds a bus by name
+int SDLAudio::FindBus(const char* name) const {
+    for (int ii = 0; ii < busCount; ++ii) {
+        if (buses[ii].name == name) {
+            return ii;
+        }
+    }
+    return NOBUS;
+}
+
+// Set a bus's volume
+void SDLAudio::BusVolume(int bus, int volume) {
+    if (bus >= 0 && bus < busCount) {
+        buses[bus].volume = (volume < 0 ? 0 : (volume > MIX_MAX_VOLUME ? MIX_MAX_VOLUME : volume));
+        busesDirty = true;
+    }
+}
+
+// Get a bus's volume
+int SDLAudio::BusVolume(int bus) const {
+    return (bus >= 0 && bus < busCount ? buses[bus].volume : 0);
+}
+
+// Mute or unmute a bus
+void SDLAudio::MuteBus(int bus, bool mute) {
+    if (bus >= 0 && bus < busCount) {
+        buses[bus].muted = mute;
+        busesDirty = true;
+    }
+}
+
+// Ducks a bus while another one plays
+void SDLAudio::BusDucking(int bus, int triggerBus, int duckVolume, Uint32 fadeMilliseconds) {
+    if (bus >= 0 && bus < busCount && triggerBus >= NOBUS && triggerBus < busCount) {
+        buses[bus].duckTrigger = (duckVolume >= MIX_MAX_VOLUME ? NOBUS : triggerBus);
+        buses[bus].duckVolume = (duckVolume < 0 ? 0 : duckVolume);
+        buses[bus].duckTime = fadeMilliseconds;
+    }
+}
+
+// Sends a sound through a bus
+void SDLAudio::SoundBus(int soundIndex, int bus) {
+    if (ValidSoundIndex(soundIndex) && bus >= 0 && bus < busCount) {
+        soundEffects[soundIndex].bus = bus;
+    }
+}
+
+// The mixer volume a channel on a bus should have
+int SDLAudio::BusChannelVolume(int bus) const {
+    if (bus < 0 || bus >= busCount) {
+        return effectsVolume;
+    }
+    return (int)(buses[bus].gain * MIX_MAX_VOLUME + 0.5f);
+}
+
+// Moves ducking along and pushes changed bus gains to the mixer
+void SDLAudio::UpdateBuses() {
+    Uint32 now = SDL_GetTicks();
+    Uint32 elapsed = now - lastBusUpdate;
+    lastBusUpdate = now;
+
+    // Which buses have something playing (a voice on a bus counts for its parents too)
+    bool active[MAXBUSES] = { false };
+    for (int ii = 0; ii < channelCount; ++ii) {
+        if (channelOwner[ii].load() != NOOWNER) {
+            for (int bus = channelBus[ii]; bus != NOBUS && !active[bus]; bus = buses[bus].parent) {
+                active[bus] = true;
+            }
+        }
+    }
+
+    // Ducking fades toward where it should be
+    for (int ii = 0; ii < busCount; ++ii) {
+        Bus& bus = buses[ii];
+        float target = 1.0f;
+        if (bus.duckTrigger != NOBUS && active[bus.duckTrigger]) {
+            target = (float)bus.duckVolume / MIX_MAX_VOLUME;
+        }
+        if (bus.duckLevel == target) {
+            continue;
+        }
+        float step = (bus.duckTime > 0 ? (float)elapsed / bus.duckTime : 1.0f);
+        if (bus.duckLevel < target) {
+            bus.duckLevel = (bus.duckLevel + step > target ? target : bus.duckLevel + step);
+        }
+        else {
+            bus.duckLevel = (bus.duckLevel - step < target ? target : bus.duckLevel - step);
+        }
+        busesDirty = true;
+    }
+
+    ApplyBuses();
+}
+
+// Works out bus gains and pushes the channel volumes that changed, if anything changed
+// (or a fade that held a change back might have ended)
+void SDLAudio::ApplyBuses() {
+    if (!busesDirty && !fadesPending) {
+        return;
+    }
+    if (busesDirty) {
+        busesDirty = false;
+        for (int ii = 0; ii < busCount; ++ii) {
+            Bus& bus = buses[ii];
+            float parentGain = (bus.parent == NOBUS ? (float)effectsVolume / MIX_MAX_VOLUME : buses[bus.parent].gain);
+            bus.gain = (bus.muted ? 0.0f : (float)bus.volume / MIX_MAX_VOLUME) * bus.duckLevel * parentGain;
+        }
+    }
+
+    fadesPending = false;
+    for (int ii = 0; ii < channelCount; ++ii) {
+        if (channelOwner[ii].load() == NOOWNER) {
+            continue;
+        }
+        int volume = BusChannelVolume(channelBus[ii]);
+        if (volume == channelVolume[ii]) {
+            continue;
+        }
+        // SDL_mixer rewrites a fading channel's volume every callback and puts back the volume
+        // the fade started from when it ends, so anything set now would be lost. channelVolume
+        // keeps that starting volume, and the change goes in once the fade is over.
+        if (Mix_FadingChannel(ii) != MIX_NO_FADING) {
+            fadesPending = true;
+            continue;
+        }
+        channelVolume[ii] = volume;
+        Mix_Volume(ii, volume);
+    }
 }
\ No newline at end of file
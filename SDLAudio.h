@@ -1,125 +1,566 @@
-#ifndef SDLAUDIO_H_
-#define SDLAUDIO_H_
-
-#include <vector>
-#include "SDL_mixer.h"
-
-using std::vector;
-
-class SDLAudio {
-private:
-    struct SoundEffect {
-        Mix_Chunk* effect;
-        const char* fileName;
-        int refCount;
-        vector<int> channels;
-
-        SoundEffect(Mix_Chunk* effect, const char* fileName);
-    };
-    // Members
-    // Music
-    Mix_Music* music;
-    bool pausedMusic;
-    int soundCount;
-
-    // Vector of sound effects
-    vector<SoundEffect> soundEffects;
-
-    // Helper Method
-    void StartMusic(int loop, bool overridePause, int milliseconds, bool fade);
-    int StartSound(int soundIndex, int loop, int milliseconds, bool fade);
-    bool ValidSoundIndex(int soundIndex) const;
-    
-
-    // Singleton
-    SDLAudio();
-    SDLAudio(const SDLAudio& rhs);
-    SDLAudio& operator=(const SDLAudio& rhs);
-public:
-
-    // Friend function for Sound Effect Unhooking
-    friend void ChannelFinished(int channel);
-
-    // Destructor
-    ~SDLAudio();
-
-    // Instance function
-    static SDLAudio* Instance();
-
-    // Initializes all audio
-    void Init();
-
-    // Cleans up any dynamic memory allocated for audio
-    void Shutdown();
-
-    // Load music
-    void LoadMusic(const char* fileName);
-
-    // Change music
-    void ChangeMusic(const char* fileName, int loop = -1);
-
-    // Unload music
-    void UnloadMusic();
-
-    // Play music (0 means play 0 times, -1 forever)
-    void PlayMusic(int loop = -1, bool overridePause = false);
-
-    // Stop music
-    void StopMusic();
-
-    // Pause music
-    void PauseMusic();
-
-    // Resume (Left out for now, maybe add later)
-
-    // Fade out music (if you fade while paused, the fade will not start until the song resumes)
-    void FadeOutMusic(int milliseconds);
-
-    // Fade in music
-    void FadeInMusic(int milliseconds, int loop = -1, bool overridePause = false);
-    
-    // Get the volume
-    int MusicVolume();
-
-    // 0 = mute, 128 = MIX_MAX_VOLUME = max
-    void MusicVolume(int volume);
-
-    // Mute music
-    void MuteMusic();
-
-    // Load sound
-    int LoadSound(const char* fileName);
-
-    // Unload sound
-    void UnloadSound(int soundIndex);
-
-    // Play sound
-    int PlaySoundEffect(int soundIndex, int loop = 0);
-
-    // Stop sound
-    void StopSoundEffect(int soundIndex, int channel);
-
-    // Fade in sound
-    int FadeInSoundEffect(int soundIndex, int milliseconds, int loop = 0);
-
-    // Fade out sound
-    void FadeOutSoundEffect(int soundIndex, int channel, int milliseconds);
-
-    // Pause sound
-    void PauseSoundEffect(int soundIndex, int channel);
-
-    // Mute sound
-    void MuteSoundEffects();
-
-    // Set the sound effects volume
-    void SoundEffectsVolume(int newVolume);
-
-    // Get the sound effects volume
-    int SoundEffectsVolume();
-
-    // Mute sound & music
-    void Mute();
-
-};
-
+#ifndef SDLAUDIO_H_
+#define SDLAUDIO_H_
+
+// Defines
+#define MAXCHANNELS 256
+#define NOOWNER -1
+#define BANKALIGNMENT 16
+#define LOADTHREADS 2
+#define TRACKVOICES 4
+#define TRACKBLOCK 64
+#define DEFAULTCHUNKSIZE 4096
+#define LOWLATENCYFREQUENCY 48000
+#define LOWLATENCYCHUNKSIZE 256
+#define MAXBUSES 16
+#define NOBUS -1
+
+#include <vector>
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "SDL_mixer.h"
+#include "SDLMappedFile.h"
+
+using std::vector;
+using std::atomic;
+using std::string;
+using std::unordered_map;
+using std::deque;
+using std::thread;
+using std::mutex;
+using std::condition_variable;
+
+// Called by SDL_mixer on the audio thread when a channel stops
+void ChannelFinished(int channel);
+
+// Called by SDL_mixer on the audio thread to fill the music stream with tracks
+void TrackStream(void* userData, Uint8* stream, int length);
+
+// Called by SDL_mixer on the audio thread to pan and attenuate a positioned channel
+void PositionEffect(int channel, void* stream, int length, void* userData);
+
+// Called by SDL_mixer on the audio thread after every mix, for timing
+void PostMix(void* userData, Uint8* stream, int length);
+
+// Called from SDLAudio::Update when an async load finishes. soundIndex is -1 for music.
+typedef void (*AudioLoadedCallback)(int soundIndex, bool loaded, void* userData);
+
+// The buses every SDLAudio starts with
+enum AudioBus { BUS_SFX, BUS_UI, BUS_VOICE, BUS_AMBIENT };
+
+class SDLAudio {
+public:
+    // What the audio device was opened with and how its callback is keeping up
+    struct AudioTiming {
+        int frequency;
+        Uint16 format;
+        int channels;
+        // Sample frames per callback, as the device actually delivers them
+        int chunkSize;
+        // How long one chunk lasts, the latency the buffer adds
+        double bufferMs;
+        // Time between mixer callbacks
+        double averageIntervalMs;
+        double maxIntervalMs;
+        // Time spent mixing in a callback (only measured while tracks are playing, see Timing)
+        double averageMixMs;
+        double maxMixMs;
+        Uint64 callbacks;
+        // Callbacks that came more than half a buffer late, the device probably ran dry
+        Uint64 underruns;
+    };
+
+    // How sound effects have fared against the voice limits
+    struct VoiceStats {
+        int played;
+        int dropped;
+        int stolen;
+    };
+
+    // What the audio has been up to, see Counters
+    struct AudioCounters {
+        int activeVoices;
+        int peakVoices;
+        Uint64 plays;
+        // Plays that found every voice busy and nothing of lower priority to steal
+        Uint64 noFreeChannel;
+        Uint64 dropped;
+        Uint64 stolen;
+        // Sounds, tracks and music decoded, and how long that took all together
+        Uint64 loads;
+        double loadMs;
+        // Decoded samples held in memory, and sound banks mapped
+        Uint64 residentBytes;
+        Uint64 mappedBytes;
+        // Mixer callback time (see Timing)
+        double averageMixMs;
+        double maxMixMs;
+    };
+
+private:
+    struct SoundEffect {
+        Mix_Chunk* effect;
+        string fileName;
+        int refCount;
+
+        // Voice rules: higher priority steals from lower, 0 instances means no limit
+        int priority;
+        int maxInstances;
+        Uint32 minInterval;
+        Uint32 lastPlayed;
+
+        // The bank the sound's samples live in, -1 if it owns them
+        int bank;
+
+        // Still being decoded by a loader thread, and which load will fill it in
+        bool loading;
+        Uint32 ticket;
+
+        // The bus it plays through
+        int bus;
+
+        // How long it took to decode, in performance counter ticks
+        Uint64 loadTicks;
+
+        SoundEffect(Mix_Chunk* effect, const string& fileName);
+    };
+    // Members
+    // Music
+    Mix_Music* music;
+    bool pausedMusic;
+    atomic<int> soundCount;
+
+    // Which sound owns each mixer channel (NOOWNER if it's free). Claimed by
+    // StartSound before playing and cleared by ChannelFinished on the audio thread.
+    atomic<int> channelOwner[MAXCHANNELS];
+    int channelCount;
+
+    // When each channel's sound started, for picking which voice to steal
+    Uint32 channelStarted[MAXCHANNELS];
+
+    // Vector of sound effects
+    vector<SoundEffect> soundEffects;
+
+    // Runtime counters. Bumped with relaxed atomics from whichever thread does the work,
+    // so they cost next to nothing and can be read from anywhere.
+    atomic<Uint64> playCount;
+    atomic<Uint64> dropCount;
+    atomic<Uint64> stealCount;
+    atomic<Uint64> noChannelCount;
+    atomic<Uint64> loadCount;
+    atomic<Uint64> loadTicks;
+    atomic<Uint64> residentBytes;
+    atomic<Uint64> mappedBytes;
+    atomic<int> peakVoices;
+
+    // Where converted sounds are kept between runs, empty for no cache
+    string soundCache;
+
+    // Index of every loaded sound by path, and the slots unloaded sounds left behind
+    unordered_map<string, int> soundLookup;
+    vector<int> freeSoundSlots;
+
+    // Mapped sound banks and the sounds made from them
+    struct SoundBank {
+        MappedFile* file;
+        vector<int> sounds;
+    };
+    vector<SoundBank> soundBanks;
+
+    // Async loading. Loader threads take jobs from loadQueue and hand them back
+    // through finishedLoads, which Update installs on the game thread.
+    struct LoadJob {
+        string fileName;
+        int soundIndex;
+        Uint32 ticket;
+        bool isMusic;
+        bool play;
+        int loop;
+        bool isTrack;
+        bool queued;
+        int fade;
+        AudioLoadedCallback callback;
+        void* userData;
+        Mix_Chunk* chunk;
+        Mix_Music* loadedMusic;
+        Uint64 loadTicks;
+        string cacheDirectory;
+    };
+    deque<LoadJob> loadQueue;
+    vector<LoadJob> finishedLoads;
+
+    // Everyone waiting on a sound load. A sound only gets one job however many ask for it, and they
+    // all hear back when it finishes. Kept by the load's ticket rather than in the slot, so they still
+    // do if the sound is unloaded (and the slot reused) first.
+    struct LoadWaiter {
+        AudioLoadedCallback callback;
+        void* userData;
+    };
+    unordered_map<Uint32, vector<LoadWaiter> > loadWaiters;
+    mutex loadLock;
+    condition_variable loadWake;
+    vector<thread> loaders;
+    bool stopLoaders;
+    int pendingLoads;
+    Uint32 nextTicket;
+    Uint32 musicTicket;
+
+    // Track player. Whole songs are decoded into memory and streamed through Mix_HookMusic,
+    // so they can chain and crossfade to the sample. tracks is shared with the audio thread
+    // under trackLock; only the game thread frees a track, once the audio thread marks it done.
+    enum TrackState { TRACK_FREE, TRACK_WAITING, TRACK_PLAYING, TRACK_FADING, TRACK_DONE };
+    struct TrackVoice {
+        Mix_Chunk* chunk;
+        TrackState state;
+        Uint32 position;
+        int loops;
+        Uint32 fadeIn;
+        Uint32 fadeInDone;
+        Uint32 fadeOut;
+        Uint32 fadeOutDone;
+    };
+    TrackVoice tracks[TRACKVOICES];
+    SDL_SpinLock trackLock;
+    bool tracksHooked;
+    atomic<int> trackVolume;
+    int trackFrequency;
+    Uint16 trackFormat;
+    Uint32 trackFrameSize;
+    Uint32 playTicket;
+    Uint32 queueTicket;
+
+    // Buses. Each one's gain is its volume (0 if muted) times its duck level times its parent's
+    // gain (or the sound effects volume at the top). Gains are only worked out again when
+    // something changes, then every channel whose volume moved gets it in one pass.
+    struct Bus {
+        string name;
+        int parent;
+        int volume;
+        bool muted;
+        int duckTrigger;
+        int duckVolume;
+        Uint32 duckTime;
+        float duckLevel;
+        float gain;
+    };
+    Bus buses[MAXBUSES];
+    int busCount;
+    int effectsVolume;
+    bool busesDirty;
+    Uint32 lastBusUpdate;
+    int channelBus[MAXCHANNELS];
+    int channelVolume[MAXCHANNELS];
+    // A channel fade owns the channel volume until it ends, changes for fading channels wait until then
+    bool fadesPending;
+
+    // The format the mixer is open with
+    int mixFrequency;
+    Uint16 mixFormat;
+    int mixChannels;
+
+    // Sample frames per mixer callback, worked out from what the callback is handed since the
+    // device doesn't have to use the chunk size Init asked for
+    atomic<int> mixFrames;
+
+    // Callback timing, written by the audio thread in ticks of the performance counter
+    atomic<Uint64> lastCallback;
+    atomic<Uint64> mixStart;
+    atomic<Uint64> callbackCount;
+    atomic<Uint64> intervalTotal;
+    atomic<Uint64> intervalMax;
+    atomic<Uint64> intervalCount;
+    atomic<Uint64> mixTotal;
+    atomic<Uint64> mixMax;
+    atomic<Uint64> mixCount;
+    atomic<Uint64> underrunCount;
+
+    // Positional sound. Emitter positions are kept one array per axis so UpdatePositions can work
+    // out four channels' gains at a time. The gains the audio thread uses are packed into one atomic
+    // per channel (left in the high 16 bits, right in the low, 32767 = full volume).
+    float listenerX;
+    float listenerY;
+    float falloffMin;
+    float falloffMax;
+    float panWidth;
+    alignas(16) float emitterX[MAXCHANNELS];
+    alignas(16) float emitterY[MAXCHANNELS];
+    alignas(16) Sint32 leftGains[MAXCHANNELS];
+    alignas(16) Sint32 rightGains[MAXCHANNELS];
+    atomic<Uint32> channelGains[MAXCHANNELS];
+    atomic<bool> positioned[MAXCHANNELS];
+
+    // Helper Method
+    void StartMusic(int loop, bool overridePause, int milliseconds, bool fade);
+    int StartSound(int soundIndex, int loop, int milliseconds, bool fade);
+    bool ValidSoundIndex(int soundIndex) const;
+    void ClearChannelOwners();
+    int AddSound(Mix_Chunk* chunk, const string& key);
+    Mix_Chunk* DecodeSound(const char* fileName, const string& cacheDirectory, Uint64& ticks);
+    Mix_Chunk* ConvertSound(const Uint8* data, size_t size);
+    Mix_Chunk* ReadCachedSound(const string& cacheName, Uint64 sourceHash);
+    void WriteCachedSound(const string& cacheName, Uint64 sourceHash, Mix_Chunk* chunk);
+    void CountResident(Mix_Chunk* chunk, bool add);
+    void FreeSound(int soundIndex);
+    void QueueLoad(const LoadJob& job);
+    void WaitForLoad(Uint32 ticket, AudioLoadedCallback callback, void* userData);
+    void QueueMusicLoad(const char* fileName, bool play, int loop, AudioLoadedCallback callback, void* userData);
+    void LoadWorker();
+    void StopLoaders();
+    void QueueTrackLoad(const char* fileName, bool queued, int loop, int fade);
+    void InstallTrack(Mix_Chunk* chunk, bool queued, int loop, int fade);
+    void HookTracks(bool on);
+    void ReleaseTracks();
+    void MixTracks(Uint8* stream, int length);
+    void MixTrack(TrackVoice& track, Uint8* stream, Uint32 length);
+    bool PositionalFormat() const;
+    void ResetBuses();
+    void ApplyBuses();
+    int BusChannelVolume(int bus) const;
+    Uint32 PackedGains(float x, float y) const;
+    int ClaimChannel(int soundIndex);
+    bool TryClaimChannel(int channel, int soundIndex);
+    void ReleaseChannel(int channel);
+
+    // Singleton
+    SDLAudio();
+    SDLAudio(const SDLAudio& rhs);
+    SDLAudio& operator=(const SDLAudio& rhs);
+public:
+
+    // Friend function for Sound Effect Unhooking
+    friend void ChannelFinished(int channel);
+
+    // Friend function for streaming tracks
+    friend void TrackStream(void* userData, Uint8* stream, int length);
+
+    // Friend function for callback timing
+    friend void PostMix(void* userData, Uint8* stream, int length);
+
+    // Friend function for positioned channels
+    friend void PositionEffect(int channel, void* stream, int length, void* userData);
+
+    // Destructor
+    ~SDLAudio();
+
+    // Instance function
+    static SDLAudio* Instance();
+
+    // Initializes all audio. chunkSize is the buffer in sample frames: smaller is lower latency
+    // but risks underruns (check Timing). 4096 at 44.1kHz is about 93ms.
+    void Init(int frequency = MIX_DEFAULT_FREQUENCY, Uint16 format = MIX_DEFAULT_FORMAT,
+        int channels = MIX_DEFAULT_CHANNELS, int chunkSize = DEFAULTCHUNKSIZE);
+
+    // Initializes all audio with a small buffer (256 frames at 48kHz, about 5ms) for rhythm games
+    void InitLowLatency();
+
+    // How the device was opened and how its callback is keeping up. Mixing time is only known
+    // while tracks are playing, since the track stream is the first thing every callback runs.
+    AudioTiming Timing() const;
+
+    // Clears the callback timing
+    void ResetTiming();
+
+    // Cleans up any dynamic memory allocated for audio
+    void Shutdown();
+
+    // Installs finished async loads and calls their callbacks, call once a frame
+    void Update();
+
+    // Load music
+    void LoadMusic(const char* fileName);
+
+    // Change music
+    void ChangeMusic(const char* fileName, int loop = -1);
+
+    // Load music on a loader thread, it replaces the current music in Update once it's ready
+    void LoadMusicAsync(const char* fileName, AudioLoadedCallback callback = nullptr, void* userData = nullptr);
+
+    // Change music on a loader thread, it starts playing in Update once it's ready
+    void ChangeMusicAsync(const char* fileName, int loop = -1);
+
+    // Unload music
+    void UnloadMusic();
+
+    // Play music (0 means play 0 times, -1 forever)
+    void PlayMusic(int loop = -1, bool overridePause = false);
+
+    // Stop music
+    void StopMusic();
+
+    // Pause music
+    void PauseMusic();
+
+    // Resume (Left out for now, maybe add later)
+
+    // Play a track instead of music: it's decoded whole on a loader thread, then crossfades over
+    // whatever track is playing (0 milliseconds cuts straight over). loop is how many extra times
+    // through, -1 forever. Tracks and the music functions above take turns, starting one stops the other.
+    void PlayTrack(const char* fileName, int loop = -1, int crossfadeMilliseconds = 0);
+
+    // Queue a track to follow the current one. It starts crossfadeMilliseconds before the current
+    // track's last loop ends, or exactly at the end for a gapless chain (a track looping forever
+    // never gets there). Replaces any queued track.
+    void QueueTrack(const char* fileName, int loop = 0, int crossfadeMilliseconds = 0);
+
+    // Stop the tracks, fading out over the given time
+    void StopTrack(int milliseconds = 0);
+
+    // Returns true while a track is playing or queued
+    bool TrackPlaying();
+
+    // Fade out music (if you fade while paused, the fade will not start until the song resumes)
+    void FadeOutMusic(int milliseconds);
+
+    // Fade in music
+    void FadeInMusic(int milliseconds, int loop = -1, bool overridePause = false);
+    
+    // Get the volume
+    int MusicVolume();
+
+    // 0 = mute, 128 = MIX_MAX_VOLUME = max
+    void MusicVolume(int volume);
+
+    // Mute music
+    void MuteMusic();
+
+    // Load sound
+    int LoadSound(const char* fileName);
+
+    // Load sound on a loader thread. The index comes back right away but won't play until the sound
+    // is ready (SoundReady). Unload it like any other sound. The callback comes from Update, or right
+    // away if the sound was already loaded.
+    int LoadSoundAsync(const char* fileName, AudioLoadedCallback callback = nullptr, void* userData = nullptr);
+
+    // Returns true once a sound can be played
+    bool SoundReady(int soundIndex) const;
+
+    // How many async loads haven't been installed yet (a level is preloaded when this hits 0)
+    int PendingLoads() const { return pendingLoads; }
+
+    // Unload sound
+    void UnloadSound(int soundIndex);
+
+    // Packs sounds into a bank file, already converted to the format the mixer is open with.
+    // Returns false if a sound couldn't be loaded or the bank couldn't be written.
+    bool PackSoundBank(const char* bankName, const char* const* fileNames, int count);
+
+    // Maps a bank and makes every sound in it without copying or decoding. Sounds are then found
+    // with LoadSound using the name they were packed with. Returns the bank index, or -1 if the
+    // bank couldn't be opened or was packed for a different mixer format.
+    int LoadSoundBank(const char* bankName);
+
+    // Unloads every sound in a bank (even ones still referenced) and unmaps it
+    void UnloadSoundBank(int bankIndex);
+
+    // Keeps sounds converted to the mixer's format in a directory (which must exist), keyed by
+    // a hash of the source file and the format. The first load converts it (WAVs through an audio
+    // stream, other formats through SDL_mixer) and writes the result; later loads, in this run or
+    // the next, just read the samples back.
+    // Pass nullptr or "" to stop caching. Sounds and tracks already loaded aren't affected.
+    void SoundCache(const char* directory);
+
+    // Play sound
+    int PlaySoundEffect(int soundIndex, int loop = 0);
+
+    // Stop sound
+    void StopSoundEffect(int soundIndex, int channel);
+
+    // Fade in sound
+    int FadeInSoundEffect(int soundIndex, int milliseconds, int loop = 0);
+
+    // Fade out sound
+    void FadeOutSoundEffect(int soundIndex, int channel, int milliseconds);
+
+    // Pause sound
+    void PauseSoundEffect(int soundIndex, int channel);
+
+    // Mute sound
+    void MuteSoundEffects();
+
+    // Set the sound effects volume (every bus sits under it, takes effect right away)
+    void SoundEffectsVolume(int newVolume);
+
+    // Get the sound effects volume
+    int SoundEffectsVolume();
+
+    // Mute sound & music
+    void Mute();
+
+    // Adds a bus, under parent if given. Returns its index or NOBUS if there are MAXBUSES already.
+    int AddBus(const char* name, int parent = NOBUS);
+
+    // Finds a bus by name, NOBUS if there isn't one
+    int FindBus(const char* name) const;
+
+    // Set a bus's volume, 0 = mute, 128 = max
+    void BusVolume(int bus, int volume);
+
+    // Get a bus's volume
+    int BusVolume(int bus) const;
+
+    // Mute or unmute a bus (and everything under it)
+    void MuteBus(int bus, bool mute = true);
+
+    // Ducks a bus down to duckVolume while anything on triggerBus plays, fading over fadeMilliseconds
+    // (voice lines ducking the ambience, say). A duckVolume of 128 turns it off.
+    void BusDucking(int bus, int triggerBus, int duckVolume, Uint32 fadeMilliseconds = 200);
+
+    // Sends a sound through a bus (sounds start on BUS_SFX)
+    void SoundBus(int soundIndex, int bus);
+
+    // Moves ducking along and pushes changed bus gains to the mixer. Update calls this.
+    void UpdateBuses();
+
+    // Sets how many sounds can play at once (at most MAXCHANNELS)
+    void Voices(int count);
+
+    // Gets how many sounds can play at once
+    int Voices() const { return channelCount; }
+
+    // Sets a sound's voice rules. When every voice is busy a sound steals the quietest, then oldest,
+    // voice of lower priority. maxInstances caps how many copies play at once (0 = no cap) and
+    // minInterval (milliseconds) drops retriggers that come too soon after the last play.
+    void SoundVoiceRules(int soundIndex, int priority, int maxInstances = 0, Uint32 minInterval = 0);
+
+    // Played, dropped and stolen counts
+    VoiceStats SoundStats() const;
+
+    // Zeroes the played, dropped and stolen counts
+    void ResetSoundStats();
+
+    // Sets where the listener is
+    void Listener(float x, float y);
+
+    // Sets how positioned sounds fall off: full volume within minDistance, silent past maxDistance,
+    // and panned all the way to one side panWidth away from the listener
+    void Falloff(float minDistance, float maxDistance, float panWidth);
+
+    // Positions a playing sound (the channel PlaySoundEffect returned). Only works when the mixer
+    // is open in stereo with 16 bit or float samples.
+    void PositionSound(int channel, float x, float y);
+
+    // Works out the gains of every positioned sound in one pass. Update calls this.
+    void UpdatePositions();
+
+    // Voices, plays, failures, loads, memory and mixer time. Safe to call from any thread.
+    AudioCounters Counters() const;
+
+    // Zeroes the counters (peak voices starts again from what's playing now)
+    void ResetCounters();
+
+    // How long a sound took to decode, in milliseconds (0 for banked sounds)
+    double SoundLoadMs(int soundIndex) const;
+
+    // Number of sound effects playing right now
+    int SoundCount() const { return soundCount.load(); }
+
+    // Which sound is playing on a channel, -1 if none
+    int ChannelOwner(int channel) const;
+
+};
+
 #endif // SDLAUDIO_H_
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "SDLContext.h"
+#include <mutex>
+#include <SDL_image.h>
+
+// Using statements
+using std::mutex;
+using std::lock_guard;
+
+// Who is using what
+static mutex startupLock;
+static int subsystemUsers[32] = { 0 };
+static int sdlUsers = 0;
+static int imageUsers = 0;
+
+// Starts SDL subsystems
+bool AcquireSDL(const Uint32 subsystems)
+{
+   lock_guard<mutex> guard(startupLock);
+   if (SDL_InitSubSystem(subsystems) != 0) {
+      return false;
+   }
+   for (int ii = 0; ii < 32; ++ii) {
+      if (subsystems & (1u << ii)) {
+         subsystemUsers[ii]++;
+      }
+   }
+   sdlUsers++;
+   return true;
+}
+
+// Stops subsystems nothing else is using
+void ReleaseSDL(const Uint32 subsystems)
+{
+   lock_guard<mutex> guard(startupLock);
+   if (sdlUsers == 0) {
+      return;
+   }
+   for (int ii = 0; ii < 32; ++ii) {
+      Uint32 flag = (1u << ii);
+      if ((subsystems & flag) && subsystemUsers[ii] > 0) {
+         subsystemUsers[ii]--;
+         SDL_QuitSubSystem(flag);
+      }
+   }
+
+   // Last one out (and no one started anything else behind our back)
+   sdlUsers--;
+   if (sdlUsers == 0 && SDL_WasInit(SDL_INIT_EVERYTHING) == 0) {
+      SDL_Quit();
+   }
+}
+
+// Starts SDL_image's decoders
+void AcquireImages()
+{
+   lock_guard<mutex> guard(startupLock);
+   if (imageUsers++ == 0) {
+      IMG_Init(IMG_INIT_JPG | IMG_INIT_PNG | IMG_INIT_TIF | IMG_INIT_WEBP);
+   }
+}
+
+// Stops them once no texture cache is using them
+void ReleaseImages()
+{
+   lock_guard<mutex> guard(startupLock);
+   if (imageUsers > 0 && --imageUsers == 0) {
+      IMG_Quit();
+   }
+}
+
+// Constructor
+SDLContext::SDLContext()
+{
+}
+
+// Destructor
+SDLContext::~SDLContext()
+{
+   Shutdown();
+}
+
+// Opens a window and gets its textures ready
+void SDLContext::Init(const char* title, const int screenWidth, const int screenHeight,
+   const bool fullscreen, const bool vsync)
+{
+   Shutdown();
+   display.Init(title, screenWidth, screenHeight, fullscreen, vsync);
+   images.Init(display.Renderer(), display.Screen());
+}
+
+// Makes a window-less surface to draw into and gets its textures ready
+void SDLContext::InitOffscreen(const int width, const int height)
+{
+   Shutdown();
+   display.InitOffscreen(width, height);
+   images.Init(display.Renderer(), display.Screen());
+}
+
+// Unloads the textures and closes the window (textures go first, they belong to the renderer)
+void SDLContext::Shutdown()
+{
+   images.Shutdown();
+   display.Shutdown();
+}
@@ -0,0 +1,64 @@
+#ifndef SDLCONTEXT_H_
+#define SDLCONTEXT_H_
+
+// Includes
+#include <SDL.h>
+#include "SDLWindow.h"
+#include "SDLTexture.h"
+
+// SDL and SDL_image are started once for the whole process, but any number of windows, texture
+// caches and contexts can come and go on different threads. These count who is using what so
+// only the last one out shuts it down. They're safe to call from any thread.
+
+// Starts SDL subsystems (SDL_INIT_VIDEO and so on)
+bool AcquireSDL(const Uint32 subsystems);
+
+// Stops them once nothing else is using them, and quits SDL when nothing is left
+void ReleaseSDL(const Uint32 subsystems);
+
+// Starts SDL_image's decoders
+void AcquireImages();
+
+// Stops them once no texture cache is using them
+void ReleaseImages();
+
+// A window (or a window-less offscreen surface) with its own renderer and texture cache.
+// The win and tex macros still point at the default SDLWindow and SDLTexture; contexts are
+// for when you need more than one, like a tool rendering thumbnails on every core.
+// A context is used by one thread at a time. Offscreen contexts use the software renderer,
+// so each can live on its own thread; windowed ones belong on the main thread like any window.
+class SDLContext {
+private:
+   // Members
+   SDLWindow display;
+   SDLTexture images;
+
+   // Copy Constructor
+   SDLContext(const SDLContext& rhs) {};
+
+   // Assignment Operator
+   SDLContext& operator=(const SDLContext& rhs) { return *this; }
+
+public:
+   // Constructor
+   SDLContext();
+
+   // Destructor
+   ~SDLContext();
+
+   // Opens a window and gets its textures ready
+   void Init(const char* title = "My Window", const int screenWidth = 640, const int screenHeight = 480,
+      const bool fullscreen = false, const bool vsync = false);
+
+   // Makes a window-less surface to draw into and gets its textures ready
+   void InitOffscreen(const int width, const int height);
+
+   // Unloads the textures and closes the window
+   void Shutdown();
+
+   // Accessors
+   SDLWindow* Window() { return &display; }
+   SDLTexture* Textures() { return &images; }
+};
+
+#endif // SDLCONTEXT_H_
@@ -0,0 +1,24 @@
+#ifndef SDLHASH_H_
+#define SDLHASH_H_
+
+// Defines
+#define HASHSEED 14695981039346656037ULL
+#define HASHPRIME 1099511628211ULL
+
+// Includes
+#include <SDL.h>
+
+// 64 bit FNV-1a. Not cryptographic, just quick and spreads file contents and names well
+// enough to key caches and lookup tables. Pass the last result back in as the hash to
+// keep going over more data.
+inline Uint64 HashBytes(const void* data, size_t size, Uint64 hash = HASHSEED)
+{
+   const Uint8* bytes = (const Uint8*)data;
+   for (size_t ii = 0; ii < size; ++ii) {
+      hash ^= bytes[ii];
+      hash *= HASHPRIME;
+   }
+   return hash;
+}
+
+#endif // SDLHASH_H_
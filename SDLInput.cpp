@@ -1,258 +1,1070 @@
-#include "SDLInput.h"
-#include <cstring>
-
-SDLInput::SDLInput() {
-    
-}
-
-// Destructor
-SDLInput::~SDLInput() {
-    
-}
-
-// Instance
-SDLInput* SDLInput::Instance() {
-    // Lazy instantiation
-    static SDLInput instance;
-    return &instance;
-}
-
-// Initializes the Input
-void SDLInput::Init() {
-    // Wipe out the keys
-    keys.clear();
-    prevKeys.clear();
-    memset(buttons, 0, sizeof(bool) * NUMBUTTONS);
-    memset(prevButtons, 0, sizeof(bool) * NUMBUTTONS);
-    mods = prevMods = KMOD_NONE;
-    doubleClicked = false;
-    mousePos.x = mousePos.y = 0;
-    quit = false;
-    anyKeyDown = anyKeyPress = anyKeyRelease = false;
-    // Start the class by polling the input at least once
-    Update();
-}
-
-// Shuts down the input
-void SDLInput::Shutdown() {
-    // Wipe out the keys
-    keys.clear();
-    prevKeys.clear();
-    memset(buttons, 0, sizeof(bool) * NUMBUTTONS);
-    memset(prevButtons, 0, sizeof(bool) * NUMBUTTONS);
-    mods = prevMods = KMOD_NONE;
-    doubleClicked = false;
-    mousePos.x = mousePos.y = 0;
-    quit = false;
-    anyKeyDown = anyKeyPress = anyKeyRelease = false;
-}
-
-// Updates the controls
-void SDLInput::Update() {
-    // Update the previous keys/buttons first
-    prevKeys.clear();
-    prevKeys = keys;
-    anyKeyDown = anyKeyPress = anyKeyRelease = false;
-    memcpy(prevButtons, buttons, sizeof(bool) * NUMBUTTONS);
-    prevMods = mods;
-
-    // Check the controls
-    SDL_PollEvent(&controlEvent);
-
-    // Handle the events
-    switch (controlEvent.type)
-    {
-        case SDL_KEYDOWN:
-        {
-            // Key DOWN bool
-            anyKeyDown = true;
-            UpdateKeyPress((SDL_KeyboardEvent*)&controlEvent);
-            break;
-        }
-        case SDL_KEYUP:
-        {
-            anyKeyRelease = true;
-            UpdateKeyRelease((SDL_KeyboardEvent*)&controlEvent);
-            break;
-        }
-        case SDL_MOUSEBUTTONDOWN:
-        {
-            UpdateMousePress((SDL_MouseButtonEvent*)&controlEvent);
-            break;
-        }
-        case SDL_MOUSEBUTTONUP:
-        {
-            UpdateMouseRelease((SDL_MouseButtonEvent*)&controlEvent);
-            break;
-        }
-        case SDL_MOUSEMOTION:
-        {
-            UpdateMousePosition((SDL_MouseMotionEvent*)&controlEvent);
-            break;
-        }
-        case SDL_QUIT:
-        {
-            quit = true;
-            break;
-        }
-        default:
-        {
-            break;
-        }
-    };
-
-    // Determine key PRESS bool here
-    // For every currently down key
-    for (std::map<SDL_Keycode, bool>::iterator retardedIter = keys.begin();
-    retardedIter != keys.end();) {
-        // Was it down last frame?
-        if (prevKeys.count(retardedIter->first) == 0) {
-            // If not, anyKeyPress is true
-            anyKeyPress = true;
-            // Stop the loop early
-            retardedIter = keys.end();
-        }
-
-        // Our code is fucking retarded
-        if (retardedIter != keys.end()) {
-            // Hold his fucking hand while
-            // he takes a fucking piss
-            // so he doesn't piss the front
-            // of his fucking pants
-            retardedIter++;
-        }
-    }
-
-}
-
-// Sets a key to the status of "pressed"
-void SDLInput::UpdateKeyPress(SDL_KeyboardEvent* keyEvent) {
-    keys[keyEvent->keysym.sym] = true;
-    mods = keyEvent->keysym.mod;
-}
-
-// Sets a key to the status of "released"
-void SDLInput::UpdateKeyRelease(SDL_KeyboardEvent* keyEvent) {
-    keys[keyEvent->keysym.sym] = false;
-    mods = keyEvent->keysym.mod;
-}
-
-// Sets a button to the status of "pressed"
-void SDLInput::UpdateMousePress(SDL_MouseButtonEvent* mouseEvent) {
-    if (mouseEvent->button < NUMBUTTONS) {
-        buttons[mouseEvent->button] = true;
-        doubleClicked = false;
-        if (mouseEvent->clicks > 1) {
-            doubleClicked = true;
-        }
-    }
-}
-
-// Sets a button to the status of "released"
-void SDLInput::UpdateMouseRelease(SDL_MouseButtonEvent* mouseEvent) {
-    if (mouseEvent->button < NUMBUTTONS) {
-        buttons[mouseEvent->button] = false;
-    }
-}
-
-// Updates the mouse position from movement
-void SDLInput::UpdateMousePosition(SDL_MouseMotionEvent* mouseEvent) {
-    // The position
-    mousePos.x = mouseEvent->x;
-    mousePos.y = mouseEvent->y;
-    // Also update the buttons (if they are holding a button down and dragging)
-    buttons[SDL_BUTTON_LEFT] = (mouseEvent->state & SDL_BUTTON_LMASK) > 0;
-    buttons[SDL_BUTTON_MIDDLE] = (mouseEvent->state & SDL_BUTTON_MMASK) > 0;
-    buttons[SDL_BUTTON_RIGHT] = (mouseEvent->state & SDL_BUTTON_RMASK) > 0;
-    buttons[SDL_BUTTON_X1] = (mouseEvent->state & SDL_BUTTON_X1MASK) > 0;
-    buttons[SDL_BUTTON_X2] = (mouseEvent->state & SDL_BUTTON_X2MASK) > 0;
-}
-
-// Returns true if a key is down
-bool SDLInput::KeyDown(const SDL_Keycode key) const {
-    // A key is down if it's down, period
-    if (keys.count(key) > 0) {
-        return keys.at(key);
-    }
-    return false;
-}
-
-// Returns true if a key is down (modifiers)
-bool SDLInput::KeyDown(const SDL_Keymod key) const {
-    return (mods & key) > 0;
-}
-
-// Returns true if a key is up
-bool SDLInput::KeyUp(const SDL_Keycode key) const {
-    // A key is up if it is simply not down THIS frame
-    if (keys.count(key) == 0 || keys.at(key) == false) {
-        return true;
-    }
-    return false;
-}
-
-// Returns true if a key is down (modifiers)
-bool SDLInput::KeyUp(const SDL_Keymod key) const {
-    return (mods & key) == 0;
-}
-
-// Returns true if a key is pressed
-bool SDLInput::KeyPressed(const SDL_Keycode key) const {
-    // A key is PRESSED if it WASN'T down last frame, but it IS down this frame
-    if ((prevKeys.count(key) == 0 || prevKeys.at(key) == false) 
-        && keys.count(key) > 0 && keys.at(key) == true) {
-        return true;
-    }
-    return false;
-}
-
-// Returns true if a key is pressed (modifiers)
-bool SDLInput::KeyPressed(const SDL_Keymod key) const {
-   return (((mods & key) > 0) && ((prevMods & key) == 0));
-}
-
-// Returns true if a key is released
-bool SDLInput::KeyReleased(const SDL_Keycode key) const {
-    // A key is considered RELEASED if it was down last frame, but released this frame
-    if (prevKeys.count(key) > 0 && prevKeys.at(key) && keys.at(key) == false) {
-        return true;
-    }
-    return false;
-}
-
-// Returns true if a key is released (modifiers)
-bool SDLInput::KeyReleased(const SDL_Keymod key) const {
-    return (((mods & key) == 0) && ((prevMods & key) > 0));
-}
-
-// Returns true if a button is down
-bool SDLInput::ButtonDown(const int button) const {
-    if (button < NUMBUTTONS) {
-        return buttons[button];
-    }
-    return false;
-}
-
-// Returns true if a button is up
-bool SDLInput::ButtonUp(const int button) const {
-    if (button < NUMBUTTONS) {
-        return !buttons[button];
-    }
-    return true;
-}
-
-// Returns true if a button is pressed
-bool SDLInput::ButtonPressed(const int button) const {
-    if (button < NUMBUTTONS) {
-        return (buttons[button] && !prevButtons[button]);
-    }
-    return false;
-}
-
-// Returns true if a button is released
-bool SDLInput::ButtonReleased(const int button) const {
-    if (button < NUMBUTTONS) {
-        return (!buttons[button] && prevButtons[button]);
-    }
-    return true;
-}
+#include "SDLInput.h"
+#include "SDLWindow.h"
+#include "SDLContext.h"
+#include <cstring>
+#include <cassert>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Scancodes for the plain (non SDLK_SCANCODE_MASK) keycodes, so lookups don't have to search the keymap
+static Uint16 asciiScancodes[128];
+
+// Input State Constructor
+InputState::InputState() {
+    Reset();
+}
+
+// Wipes out everything
+void InputState::Reset() {
+    memset(keys, 0, sizeof(keys));
+    memset(pressedKeys, 0, sizeof(pressedKeys));
+    memset(releasedKeys, 0, sizeof(releasedKeys));
+    memset(buttons, 0, sizeof(bool) * NUMBUTTONS);
+    memset(pressedButtons, 0, sizeof(bool) * NUMBUTTONS);
+    memset(releasedButtons, 0, sizeof(bool) * NUMBUTTONS);
+    mods = prevMods = KMOD_NONE;
+    doubleClicked = false;
+    mousePos.x = mousePos.y = 0;
+    mouseDelta.x = mouseDelta.y = 0;
+    mouseWheel.x = mouseWheel.y = 0;
+    quit = false;
+    anyKeyDown = anyKeyPress = anyKeyRelease = false;
+    memset(padConnected, 0, sizeof(padConnected));
+    memset(padButtons, 0, sizeof(padButtons));
+    memset(pressedPadButtons, 0, sizeof(pressedPadButtons));
+    memset(releasedPadButtons, 0, sizeof(releasedPadButtons));
+    memset(padAxes, 0, sizeof(padAxes));
+    memset(actions, 0, sizeof(actions));
+    memset(pressedActions, 0, sizeof(pressedActions));
+    memset(releasedActions, 0, sizeof(releasedActions));
+}
+
+SDLInput::SDLInput() {
+    display = SDLWindow::Instance();
+    started = false;
+    eventCount = 0;
+    updateTime = 0.0f;
+    frameStart = 0;
+    recordFrame = 0;
+    memset(history, 0, sizeof(history));
+    historyCount = frameFirstEvent = frameNumber = frameTicks = 0;
+    eventTime = 0;
+    motionPending = false;
+    motionPos.x = motionPos.y = 0;
+    motionState = 0;
+    keepMouseSamples = false;
+    mouseSampleCount = 0;
+    framePressCount = 0;
+    memset(listenedKeys, 0, sizeof(listenedKeys));
+    quitThisFrame = false;
+    memset(controllers, 0, sizeof(controllers));
+    memset(controllerIds, 0, sizeof(controllerIds));
+    memset(rawAxes, 0, sizeof(rawAxes));
+    memset(axesChanged, 0, sizeof(axesChanged));
+    deadzone = 8000;
+}
+
+// Destructor
+SDLInput::~SDLInput() {
+    
+}
+
+// Instance
+SDLInput* SDLInput::Instance() {
+    // Lazy instantiation
+    static SDLInput instance;
+    return &instance;
+}
+
+// Turns a keycode into the scancode its state is stored under
+SDL_Scancode InputState::KeyToScancode(const SDL_Keycode key) {
+    // Keys without a character are just their scancode
+    if (key & SDLK_SCANCODE_MASK) {
+        int scancode = key & ~SDLK_SCANCODE_MASK;
+        return (scancode < SDL_NUM_SCANCODES ? (SDL_Scancode)scancode : SDL_SCANCODE_UNKNOWN);
+    }
+    // Characters come from the layout
+    if (key >= 0 && key < 128) {
+        return (SDL_Scancode)asciiScancodes[key];
+    }
+    // Anything else is rare enough to ask SDL
+    return SDL_GetScancodeFromKey(key);
+}
+
+// Initializes the Input
+void SDLInput::Init() {
+    // Wipe out the keys
+    Reset();
+    UpdateKeymap();
+
+    // Controllers that are already plugged in show up as added events
+    if (!started) {
+        started = AcquireSDL(SDL_INIT_GAMECONTROLLER);
+    }
+
+    // Start the class by polling the input at least once
+    Update();
+}
+
+// Sets the window input is for
+void SDLInput::AttachWindow(SDLWindow* window) {
+    display = (window ? window : SDLWindow::Instance());
+}
+
+// Shuts down the input
+void SDLInput::Shutdown() {
+    StopRecording();
+    StopReplay();
+
+    // Close the controllers
+    for (int ii = 0; ii < MAXCONTROLLERS; ++ii) {
+        if (controllers[ii]) {
+            SDL_GameControllerClose(controllers[ii]);
+            controllers[ii] = nullptr;
+        }
+    }
+    memset(rawAxes, 0, sizeof(rawAxes));
+    memset(axesChanged, 0, sizeof(axesChanged));
+    if (started) {
+        ReleaseSDL(SDL_INIT_GAMECONTROLLER);
+        started = false;
+    }
+
+    // Wipe out the keys
+    Reset();
+}
+
+// Updates the controls
+void SDLInput::Update() {
+    BeginFrame();
+
+    // Handle everything that's waiting
+    SDL_PumpEvents();
+    DrainEvents();
+    InjectedEvents();
+    ReplayEvents();
+
+    EndFrame();
+}
+
+// Sleeps until something happens (or the timeout runs out), then updates the controls
+bool SDLInput::WaitUpdate(const int timeoutMs) {
+    // A replay has to keep going
+    if (Replaying()) {
+        Update();
+        return true;
+    }
+
+    // So do injected pad events, SDL doesn't know they're waiting
+    if (!injectedEvents.empty()) {
+        display->MarkDirty(false);
+        Update();
+        return true;
+    }
+
+    // Block until there's an event (not counted as update time)
+    int gotEvent = 0;
+    if (timeoutMs < 0) {
+        gotEvent = SDL_WaitEvent(&controlEvent);
+    }
+    else {
+        gotEvent = SDL_WaitEventTimeout(&controlEvent, timeoutMs);
+    }
+
+    BeginFrame();
+
+    if (gotEvent) {
+        // Anything but a wake up from MarkDirty means the screen has to change
+        // (we're already awake, so don't push another wake up event)
+        if (controlEvent.type != display->WakeEventType()) {
+            display->MarkDirty(false);
+        }
+        ConsumeEvent(controlEvent);
+        ++eventCount;
+
+        // Then everything that came in with it
+        DrainEvents();
+    }
+
+    EndFrame();
+    return gotEvent != 0;
+}
+
+// Handles every event in the queue, a batch at a time
+void SDLInput::DrainEvents() {
+    int count = 0;
+    do {
+        count = SDL_PeepEvents(eventBatch, EVENTBATCH, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT);
+        for (int ii = 0; ii < count; ++ii) {
+            ConsumeEvent(eventBatch[ii]);
+        }
+        if (count > 0) {
+            eventCount += count;
+        }
+    } while (count == EVENTBATCH);
+}
+
+// Swaps an event's controller id for the slot, then records (or while replaying, filters out) and applies it
+void SDLInput::ConsumeEvent(SDL_Event& event) {
+    // Controllers are opened and closed even while a replay is running
+    if (!PadEventToSlot(event)) {
+        return;
+    }
+    ConsumeSlotEvent(event);
+}
+
+// Records (or while replaying, filters out) an event whose controller events carry the slot, then applies it
+void SDLInput::ConsumeSlotEvent(SDL_Event& event) {
+    if (replayer.IsOpen()) {
+        // The recording is in charge of the controls
+        switch (event.type)
+        {
+            case SDL_KEYDOWN:
+            case SDL_KEYUP:
+            case SDL_MOUSEBUTTONDOWN:
+            case SDL_MOUSEBUTTONUP:
+            case SDL_MOUSEMOTION:
+            case SDL_MOUSEWHEEL:
+            case SDL_CONTROLLERBUTTONDOWN:
+            case SDL_CONTROLLERBUTTONUP:
+            case SDL_CONTROLLERAXISMOTION:
+            case SDL_CONTROLLERDEVICEADDED:
+            case SDL_CONTROLLERDEVICEREMOVED:
+                return;
+            default:
+                break;
+        };
+    }
+    else {
+        eventTime = event.common.timestamp;
+        if (recorder.IsOpen()) {
+            recorder.Record(recordFrame, event);
+        }
+    }
+    HandleEvent(event);
+}
+
+// Applies the events InjectPadEvent queued
+void SDLInput::InjectedEvents() {
+    for (unsigned int ii = 0; ii < injectedEvents.size(); ++ii) {
+        ConsumeSlotEvent(injectedEvents[ii]);
+        ++eventCount;
+    }
+    injectedEvents.clear();
+}
+
+// Feeds in a controller event by pad slot
+void SDLInput::InjectPadEvent(const SDL_Event& event) {
+    assert((event.type == SDL_CONTROLLERDEVICEADDED || event.type == SDL_CONTROLLERDEVICEREMOVED
+        || event.type == SDL_CONTROLLERBUTTONDOWN || event.type == SDL_CONTROLLERBUTTONUP
+        || event.type == SDL_CONTROLLERAXISMOTION) && "Only controller events can be injected");
+    injectedEvents.push_back(event);
+}
+
+// Applies the recorded events for this frame
+void SDLInput::ReplayEvents() {
+    if (!replayer.IsOpen()) {
+        return;
+    }
+    SDL_Event event;
+    while (replayer.Next(recordFrame, event)) {
+        eventTime = event.common.timestamp;
+        HandleEvent(event);
+        ++eventCount;
+    }
+}
+
+// Starts writing every event the controls use to a file
+bool SDLInput::StartRecording(const char* fileName) {
+    StopReplay();
+    recordFrame = 0;
+    if (!recorder.Open(fileName)) {
+        return false;
+    }
+
+    // The replay starts with no pads, so write down the ones already plugged in and what they're doing
+    SDL_Event event;
+    memset(&event, 0, sizeof(event));
+    event.common.timestamp = SDL_GetTicks();
+    for (int ii = 0; ii < MAXCONTROLLERS; ++ii) {
+        if (!padConnected[ii]) {
+            continue;
+        }
+        event.type = SDL_CONTROLLERDEVICEADDED;
+        event.cdevice.which = ii;
+        recorder.Record(recordFrame, event);
+        for (int button = 0; button < 32; ++button) {
+            if (padButtons[ii] & ((Uint32)1 << button)) {
+                event.type = SDL_CONTROLLERBUTTONDOWN;
+                event.cbutton.which = ii;
+                event.cbutton.button = (Uint8)button;
+                event.cbutton.state = SDL_PRESSED;
+                recorder.Record(recordFrame, event);
+            }
+        }
+        for (int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; ++axis) {
+            if (rawAxes[ii][axis] != 0) {
+                event.type = SDL_CONTROLLERAXISMOTION;
+                event.caxis.which = ii;
+                event.caxis.axis = (Uint8)axis;
+                event.caxis.value = rawAxes[ii][axis];
+                recorder.Record(recordFrame, event);
+            }
+        }
+    }
+    return true;
+}
+
+// Stops recording
+void SDLInput::StopRecording() {
+    recorder.Close(recordFrame);
+}
+
+// Plays a recording back instead of the real controls
+bool SDLInput::StartReplay(const char* fileName) {
+    StopRecording();
+    recordFrame = 0;
+    // Start from nothing held down, like the recording did
+    bool wasQuit = quit;
+    Reset();
+    quit = wasQuit;
+    return replayer.Open(fileName);
+}
+
+// Goes back to the real controls
+void SDLInput::StopReplay() {
+    if (replayer.IsOpen()) {
+        replayer.Close();
+        SyncPads();
+    }
+}
+
+// Clears this frame's edges
+void SDLInput::BeginFrame() {
+    frameStart = SDL_GetPerformanceCounter();
+    frameTicks = SDL_GetTicks();
+    eventCount = 0;
+    frameFirstEvent = historyCount;
+    ++frameNumber;
+
+    // Pressed/released only last one frame
+    memset(pressedKeys, 0, sizeof(pressedKeys));
+    memset(releasedKeys, 0, sizeof(releasedKeys));
+    anyKeyDown = anyKeyPress = anyKeyRelease = false;
+    memset(pressedButtons, 0, sizeof(bool) * NUMBUTTONS);
+    memset(releasedButtons, 0, sizeof(bool) * NUMBUTTONS);
+    prevMods = mods;
+    memset(pressedPadButtons, 0, sizeof(pressedPadButtons));
+    memset(releasedPadButtons, 0, sizeof(releasedPadButtons));
+    mouseDelta.x = mouseDelta.y = 0;
+    mouseWheel.x = mouseWheel.y = 0;
+    mouseSampleCount = 0;
+    framePressCount = 0;
+    quitThisFrame = false;
+}
+
+// Applies one event
+void SDLInput::HandleEvent(SDL_Event& event) {
+    RememberEvent(event);
+
+    // Motion is cheap to add up, but has to land before anything that depends on its order
+    if (motionPending && event.type != SDL_MOUSEMOTION) {
+        FlushMouseMotion();
+    }
+
+    // Handle the events
+    switch (event.type)
+    {
+        case SDL_KEYDOWN:
+        {
+            // Key DOWN bool
+            anyKeyDown = true;
+            UpdateKeyPress((SDL_KeyboardEvent*)&event);
+            break;
+        }
+        case SDL_KEYUP:
+        {
+            UpdateKeyRelease((SDL_KeyboardEvent*)&event);
+            break;
+        }
+        case SDL_MOUSEBUTTONDOWN:
+        {
+            UpdateMousePress((SDL_MouseButtonEvent*)&event);
+            break;
+        }
+        case SDL_MOUSEBUTTONUP:
+        {
+            UpdateMouseRelease((SDL_MouseButtonEvent*)&event);
+            break;
+        }
+        case SDL_MOUSEMOTION:
+        {
+            UpdateMousePosition((SDL_MouseMotionEvent*)&event);
+            break;
+        }
+        case SDL_MOUSEWHEEL:
+        {
+            UpdateMouseWheel((SDL_MouseWheelEvent*)&event);
+            break;
+        }
+        case SDL_QUIT:
+        {
+            quit = true;
+            quitThisFrame = true;
+            break;
+        }
+        case SDL_KEYMAPCHANGED:
+        {
+            UpdateKeymap();
+            break;
+        }
+        // Controller events carry the slot by now (see PadEventToSlot)
+        case SDL_CONTROLLERDEVICEADDED:
+        {
+            ConnectPad(event.cdevice.which);
+            break;
+        }
+        case SDL_CONTROLLERDEVICEREMOVED:
+        {
+            DisconnectPad(event.cdevice.which);
+            break;
+        }
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+        {
+            UpdatePadButton(event.cbutton.which, event.cbutton.button, event.cbutton.state);
+            break;
+        }
+        case SDL_CONTROLLERAXISMOTION:
+        {
+            // Just keep it, the deadzone is applied once in EndFrame
+            int slot = event.caxis.which;
+            if ((unsigned)slot < MAXCONTROLLERS && padConnected[slot] && event.caxis.axis < SDL_CONTROLLER_AXIS_MAX) {
+                rawAxes[slot][event.caxis.axis] = event.caxis.value;
+                axesChanged[slot] = true;
+            }
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    };
+}
+
+// Works out the "any key" flags
+void SDLInput::EndFrame() {
+    // The mouse ends up wherever the last motion left it
+    if (motionPending) {
+        FlushMouseMotion();
+    }
+
+    // Controller sticks/triggers that moved
+    UpdatePadAxes();
+
+    // A word at a time
+    Uint64 pressed = 0;
+    Uint64 released = 0;
+    for (int ii = 0; ii < NUMKEYWORDS; ++ii) {
+        pressed |= pressedKeys[ii];
+        released |= releasedKeys[ii];
+    }
+    anyKeyPress = (pressed != 0);
+    anyKeyRelease = (released != 0);
+
+    // All the bound actions in one go, timed by the events so a replay times them the same way
+    Uint64 newActions[ACTIONWORDS];
+    actionMap.Evaluate(*this, framePresses, framePressCount, eventTime, newActions);
+    for (int ii = 0; ii < ACTIONWORDS; ++ii) {
+        pressedActions[ii] = newActions[ii] & ~actions[ii];
+        releasedActions[ii] = actions[ii] & ~newActions[ii];
+        actions[ii] = newActions[ii];
+    }
+
+    // Tell whoever is listening
+    DispatchListeners();
+
+    // Next frame of the recording/replay
+    if (recorder.IsOpen() || replayer.IsOpen()) {
+        ++recordFrame;
+    }
+
+    // How long did all that take
+    updateTime = (float)((SDL_GetPerformanceCounter() - frameStart) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+// Adds an event to the history
+void SDLInput::RememberEvent(const SDL_Event& event) {
+    TimedEvent& timed = history[historyCount % EVENTHISTORY];
+    ++historyCount;
+
+    timed.type = event.type;
+    timed.frame = frameNumber;
+    timed.timestamp = event.common.timestamp;
+    timed.handled = SDL_GetPerformanceCounter();
+    switch (event.type)
+    {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            timed.code = event.key.keysym.scancode;
+            break;
+        case SDL_MOUSEBUTTONDOWN:
+        case SDL_MOUSEBUTTONUP:
+            timed.code = event.button.button;
+            break;
+        default:
+            timed.code = 0;
+            break;
+    };
+
+    // Back date the counter by how long it sat in the queue (replayed
+    // timestamps are from another run, so anything silly counts as no wait)
+    Uint32 waited = frameTicks - event.common.timestamp;
+    if (waited > 1000) {
+        waited = 0;
+    }
+    timed.origin = timed.handled - (Uint64)waited * SDL_GetPerformanceFrequency() / 1000;
+}
+
+// Number of events kept from the last update
+int SDLInput::FrameEventCount() const {
+    Uint32 count = historyCount - frameFirstEvent;
+    return (int)(count < EVENTHISTORY ? count : EVENTHISTORY);
+}
+
+// Returns one of the events from the last update, oldest first
+const TimedEvent& SDLInput::FrameEvent(const int index) const {
+    assert(index > -1 && index < FrameEventCount() && "Invalid event index");
+    return history[(historyCount - FrameEventCount() + index) % EVENTHISTORY];
+}
+
+// Listener handles are the table number in the top bits and the slot in the bottom 16, plus one
+#define QUITTABLE (SDL_NUM_SCANCODES + NUMBUTTONS)
+
+// Index of the lowest set bit
+static int LowestBit(const Uint64 bits) {
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index = 0;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#elif defined(__GNUC__)
+    return __builtin_ctzll(bits);
+#else
+    int index = 0;
+    while (((bits >> index) & 1) == 0) {
+        ++index;
+    }
+    return index;
+#endif
+}
+
+// Adds a listener to a table
+int SDLInput::AddListener(std::vector<Listener>& table, const int tableIndex, InputListener callback, void* userData,
+    const int code) {
+    assert(callback && "Can't add a listener without a callback");
+
+    Listener listener;
+    listener.callback = callback;
+    listener.userData = userData;
+    listener.code = code;
+
+    // Reuse a removed slot so handles stay put
+    for (unsigned int ii = 0; ii < table.size(); ++ii) {
+        if (!table[ii].callback) {
+            table[ii] = listener;
+            return ((tableIndex << 16) | (int)ii) + 1;
+        }
+    }
+    table.push_back(listener);
+    return ((tableIndex << 16) | (int)(table.size() - 1)) + 1;
+}
+
+// Calls back when a key goes down or up
+int SDLInput::AddKeyListener(const SDL_Keycode key, InputListener callback, void* userData) {
+    SDL_Scancode scancode = KeyToScancode(key);
+    listenedKeys[scancode >> 6] |= (Uint64)1 << (scancode & 63);
+    return AddListener(keyListeners[scancode], scancode, callback, userData, key);
+}
+
+// Calls back when a mouse button goes down or up
+int SDLInput::AddButtonListener(const int button, InputListener callback, void* userData) {
+    assert(button > -1 && button < NUMBUTTONS && "Invalid mouse button when adding a listener");
+    return AddListener(buttonListeners[button], SDL_NUM_SCANCODES + button, callback, userData, button);
+}
+
+// Calls back when the quit event is heard
+int SDLInput::AddQuitListener(InputListener callback, void* userData) {
+    return AddListener(quitListeners, QUITTABLE, callback, userData, 0);
+}
+
+// Removes a listener
+void SDLInput::RemoveListener(const int handle) {
+    if (handle <= 0) {
+        return;
+    }
+    int tableIndex = (handle - 1) >> 16;
+    unsigned int slot = (unsigned int)((handle - 1) & 0xFFFF);
+
+    std::vector<Listener>* table = nullptr;
+    if (tableIndex < SDL_NUM_SCANCODES) {
+        table = &keyListeners[tableIndex];
+    }
+    else if (tableIndex < QUITTABLE) {
+        table = &buttonListeners[tableIndex - SDL_NUM_SCANCODES];
+    }
+    else if (tableIndex == QUITTABLE) {
+        table = &quitListeners;
+    }
+
+    // Slots are never erased, just emptied
+    if (table && slot < table->size()) {
+        (*table)[slot].callback = nullptr;
+    }
+}
+
+// Calls every listener in a table for the edges that happened
+void SDLInput::CallListeners(const std::vector<Listener>& table, const bool pressed, const bool released,
+    const bool downNow) {
+    // A quick tap is both. If it ended up down, it came up first.
+    bool releaseFirst = (pressed && released && downNow);
+    for (int pass = 0; pass < 2; ++pass) {
+        bool down = ((pass == 0) != releaseFirst);
+        if (down ? !pressed : !released) {
+            continue;
+        }
+        // By index, a listener might add another one
+        for (unsigned int ii = 0; ii < table.size(); ++ii) {
+            if (table[ii].callback) {
+                table[ii].callback(table[ii].code, down, table[ii].userData);
+            }
+        }
+    }
+}
+
+// Calls the listeners for everything that changed this frame
+void SDLInput::DispatchListeners() {
+    // Only keys that changed and have someone listening
+    for (int ii = 0; ii < NUMKEYWORDS; ++ii) {
+        Uint64 changed = (pressedKeys[ii] | releasedKeys[ii]) & listenedKeys[ii];
+        while (changed) {
+            int scancode = (ii << 6) + LowestBit(changed);
+            changed &= changed - 1;
+            CallListeners(keyListeners[scancode], TestKey(pressedKeys, scancode), TestKey(releasedKeys, scancode),
+                TestKey(keys, scancode));
+        }
+    }
+
+    for (int ii = 0; ii < NUMBUTTONS; ++ii) {
+        if (pressedButtons[ii] || releasedButtons[ii]) {
+            CallListeners(buttonListeners[ii], pressedButtons[ii], releasedButtons[ii], buttons[ii]);
+        }
+    }
+
+    if (quitThisFrame) {
+        CallListeners(quitListeners, true, false, true);
+    }
+}
+
+// Refreshes the keycode to scancode table
+void SDLInput::UpdateKeymap() {
+    for (int ii = 0; ii < 128; ++ii) {
+        asciiScancodes[ii] = (Uint16)SDL_GetScancodeFromKey((SDL_Keycode)ii);
+    }
+    // Bindings were compiled against the old layout
+    actionMap.Invalidate();
+}
+
+// Sets a key to the status of "pressed"
+void SDLInput::UpdateKeyPress(SDL_KeyboardEvent* keyEvent) {
+    int scancode = keyEvent->keysym.scancode;
+    if (scancode > 0 && scancode < SDL_NUM_SCANCODES) {
+        Uint64 bit = (Uint64)1 << (scancode & 63);
+        // Key repeats don't count as presses
+        if ((keys[scancode >> 6] & bit) == 0) {
+            pressedKeys[scancode >> 6] |= bit;
+            // Past MAXFRAMEPRESSES in one frame the sequences just miss them
+            if (framePressCount < MAXFRAMEPRESSES) {
+                framePresses[framePressCount].scancode = (Uint16)scancode;
+                framePresses[framePressCount].timestamp = keyEvent->timestamp;
+                ++framePressCount;
+            }
+        }
+        keys[scancode >> 6] |= bit;
+    }
+    mods = keyEvent->keysym.mod;
+}
+
+// Sets a key to the status of "released"
+void SDLInput::UpdateKeyRelease(SDL_KeyboardEvent* keyEvent) {
+    int scancode = keyEvent->keysym.scancode;
+    if (scancode > 0 && scancode < SDL_NUM_SCANCODES) {
+        Uint64 bit = (Uint64)1 << (scancode & 63);
+        if (keys[scancode >> 6] & bit) {
+            releasedKeys[scancode >> 6] |= bit;
+        }
+        keys[scancode >> 6] &= ~bit;
+    }
+    mods = keyEvent->keysym.mod;
+}
+
+// Sets a button to the status of "pressed"
+void SDLInput::UpdateMousePress(SDL_MouseButtonEvent* mouseEvent) {
+    if (mouseEvent->button < NUMBUTTONS) {
+        SetButton(mouseEvent->button, true);
+        doubleClicked = false;
+        if (mouseEvent->clicks > 1) {
+            doubleClicked = true;
+        }
+    }
+}
+
+// Sets a button to the status of "released"
+void SDLInput::UpdateMouseRelease(SDL_MouseButtonEvent* mouseEvent) {
+    if (mouseEvent->button < NUMBUTTONS) {
+        SetButton(mouseEvent->button, false);
+    }
+}
+
+// Updates the mouse position from movement
+void SDLInput::UpdateMousePosition(SDL_MouseMotionEvent* mouseEvent) {
+    // Just add it up, FlushMouseMotion does the rest once
+    mouseDelta.x += mouseEvent->xrel;
+    mouseDelta.y += mouseEvent->yrel;
+    motionPos.x = mouseEvent->x;
+    motionPos.y = mouseEvent->y;
+    motionState = mouseEvent->state;
+    motionPending = true;
+
+    // Keep the path if asked, once full the last sample just follows the mouse
+    if (keepMouseSamples) {
+        int sample = (mouseSampleCount < MOUSESAMPLES ? mouseSampleCount++ : MOUSESAMPLES - 1);
+        mouseSamples[sample] = motionPos;
+        display->WindowToLogical(mouseSamples[sample].x, mouseSamples[sample].y);
+    }
+}
+
+// Applies the added up mouse motion
+void SDLInput::FlushMouseMotion() {
+    motionPending = false;
+
+    // The position
+    mousePos = motionPos;
+    // Drawing may be at a logical resolution
+    display->WindowToLogical(mousePos.x, mousePos.y);
+    // Also update the buttons (if they are holding a button down and dragging)
+    SetButton(SDL_BUTTON_LEFT, (motionState & SDL_BUTTON_LMASK) > 0);
+    SetButton(SDL_BUTTON_MIDDLE, (motionState & SDL_BUTTON_MMASK) > 0);
+    SetButton(SDL_BUTTON_RIGHT, (motionState & SDL_BUTTON_RMASK) > 0);
+    SetButton(SDL_BUTTON_X1, (motionState & SDL_BUTTON_X1MASK) > 0);
+    SetButton(SDL_BUTTON_X2, (motionState & SDL_BUTTON_X2MASK) > 0);
+}
+
+// Adds up the mouse wheel
+void SDLInput::UpdateMouseWheel(SDL_MouseWheelEvent* wheelEvent) {
+    // Some systems flip the wheel, undo that
+    int flip = (wheelEvent->direction == SDL_MOUSEWHEEL_FLIPPED ? -1 : 1);
+    mouseWheel.x += wheelEvent->x * flip;
+    mouseWheel.y += wheelEvent->y * flip;
+}
+
+// Opens a controller that was plugged in
+int SDLInput::AddController(const int deviceIndex) {
+    SDL_GameController* controller = SDL_GameControllerOpen(deviceIndex);
+    if (!controller) {
+        return -1;
+    }
+    SDL_JoystickID id = SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(controller));
+
+    // Already have it? (Init can see it twice)
+    if (ControllerSlot(id) != -1) {
+        SDL_GameControllerClose(controller);
+        return -1;
+    }
+
+    // First free slot, if we're out of slots it's ignored
+    for (int ii = 0; ii < MAXCONTROLLERS; ++ii) {
+        if (!controllers[ii]) {
+            controllers[ii] = controller;
+            controllerIds[ii] = id;
+            return ii;
+        }
+    }
+    SDL_GameControllerClose(controller);
+    return -1;
+}
+
+// Closes a controller that was unplugged
+int SDLInput::RemoveController(const SDL_JoystickID id) {
+    int slot = ControllerSlot(id);
+    if (slot == -1) {
+        return -1;
+    }
+    SDL_GameControllerClose(controllers[slot]);
+    controllers[slot] = nullptr;
+    return slot;
+}
+
+// Swaps a controller event's instance id (or device index) for the slot
+bool SDLInput::PadEventToSlot(SDL_Event& event) {
+    int slot = 0;
+    switch (event.type)
+    {
+        case SDL_CONTROLLERDEVICEADDED:
+            slot = AddController(event.cdevice.which);
+            event.cdevice.which = slot;
+            break;
+        case SDL_CONTROLLERDEVICEREMOVED:
+            slot = RemoveController(event.cdevice.which);
+            event.cdevice.which = slot;
+            break;
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+            slot = ControllerSlot(event.cbutton.which);
+            event.cbutton.which = slot;
+            break;
+        case SDL_CONTROLLERAXISMOTION:
+            slot = ControllerSlot(event.caxis.which);
+            event.caxis.which = slot;
+            break;
+        default:
+            break;
+    };
+    return slot != -1;
+}
+
+// Shows a pad as plugged in with nothing held
+void SDLInput::ConnectPad(const int slot) {
+    if ((unsigned)slot >= MAXCONTROLLERS) {
+        return;
+    }
+    padConnected[slot] = true;
+    padButtons[slot] = 0;
+    memset(rawAxes[slot], 0, sizeof(rawAxes[slot]));
+    memset(padAxes[slot], 0, sizeof(padAxes[slot]));
+}
+
+// Shows a pad as unplugged
+void SDLInput::DisconnectPad(const int slot) {
+    if ((unsigned)slot >= MAXCONTROLLERS) {
+        return;
+    }
+    padConnected[slot] = false;
+
+    // Anything held counts as let go
+    releasedPadButtons[slot] |= padButtons[slot];
+    padButtons[slot] = 0;
+    memset(rawAxes[slot], 0, sizeof(rawAxes[slot]));
+    memset(padAxes[slot], 0, sizeof(padAxes[slot]));
+}
+
+// Makes the pads match the controllers that are really plugged in
+void SDLInput::SyncPads() {
+    for (int ii = 0; ii < MAXCONTROLLERS; ++ii) {
+        DisconnectPad(ii);
+        if (!controllers[ii]) {
+            continue;
+        }
+        ConnectPad(ii);
+
+        // Whatever is held now comes back without a pressed edge
+        for (int button = 0; button < SDL_CONTROLLER_BUTTON_MAX; ++button) {
+            if (SDL_GameControllerGetButton(controllers[ii], (SDL_GameControllerButton)button)) {
+                padButtons[ii] |= (Uint32)1 << button;
+            }
+        }
+        for (int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; ++axis) {
+            rawAxes[ii][axis] = SDL_GameControllerGetAxis(controllers[ii], (SDL_GameControllerAxis)axis);
+        }
+        axesChanged[ii] = true;
+    }
+}
+
+// Finds the slot for a controller
+int SDLInput::ControllerSlot(const SDL_JoystickID id) const {
+    for (int ii = 0; ii < MAXCONTROLLERS; ++ii) {
+        if (controllers[ii] && controllerIds[ii] == id) {
+            return ii;
+        }
+    }
+    return -1;
+}
+
+// Sets a controller button up or down, remembering the edge
+void SDLInput::UpdatePadButton(const int slot, const Uint8 button, const Uint8 state) {
+    if ((unsigned)slot >= MAXCONTROLLERS || !padConnected[slot] || button >= 32) {
+        return;
+    }
+    Uint32 bit = (Uint32)1 << button;
+    if (state == SDL_PRESSED) {
+        if ((padButtons[slot] & bit) == 0) {
+            pressedPadButtons[slot] |= bit;
+        }
+        padButtons[slot] |= bit;
+    }
+    else {
+        if (padButtons[slot] & bit) {
+            releasedPadButtons[slot] |= bit;
+        }
+        padButtons[slot] &= ~bit;
+    }
+}
+
+// Applies the deadzone to the axes that moved
+void SDLInput::UpdatePadAxes() {
+    float dead = (float)deadzone;
+    float range = 32767.0f - dead;
+    for (int ii = 0; ii < MAXCONTROLLERS; ++ii) {
+        if (!axesChanged[ii]) {
+            continue;
+        }
+        axesChanged[ii] = false;
+
+        // Sticks use a round deadzone so diagonals aren't notched
+        for (int axis = SDL_CONTROLLER_AXIS_LEFTX; axis <= SDL_CONTROLLER_AXIS_RIGHTX; axis += 2) {
+            float x = rawAxes[ii][axis];
+            float y = rawAxes[ii][axis + 1];
+            float length = SDL_sqrtf(x * x + y * y);
+            if (length <= dead) {
+                padAxes[ii][axis] = padAxes[ii][axis + 1] = 0.0f;
+                continue;
+            }
+            // Rescale so the edge of the deadzone is 0
+            float scale = ((length > 32767.0f ? 32767.0f : length) - dead) / (range * length);
+            padAxes[ii][axis] = x * scale;
+            padAxes[ii][axis + 1] = y * scale;
+        }
+
+        // Triggers only go one way
+        for (int axis = SDL_CONTROLLER_AXIS_TRIGGERLEFT; axis <= SDL_CONTROLLER_AXIS_TRIGGERRIGHT; ++axis) {
+            float value = rawAxes[ii][axis];
+            padAxes[ii][axis] = (value <= dead ? 0.0f : (value - dead) / range);
+        }
+    }
+}
+
+// Sets the controller deadzone
+void SDLInput::ControllerDeadzone(const int deadzone) {
+    this->deadzone = (deadzone < 0 ? 0 : (deadzone > 32766 ? 32766 : deadzone));
+    // Everything has to be worked out again
+    for (int ii = 0; ii < MAXCONTROLLERS; ++ii) {
+        axesChanged[ii] = padConnected[ii];
+    }
+}
+
+// Hides the cursor and reports only relative motion
+void SDLInput::RelativeMouseMode(const bool relative) {
+    SDL_SetRelativeMouseMode(relative ? SDL_TRUE : SDL_FALSE);
+}
+
+// Returns true if in relative mouse mode
+bool SDLInput::RelativeMouseMode() const {
+    return SDL_GetRelativeMouseMode() == SDL_TRUE;
+}
+
+// Sets a button up or down, remembering the edge
+void SDLInput::SetButton(const int button, const bool down) {
+    if (down && !buttons[button]) {
+        pressedButtons[button] = true;
+    }
+    else if (!down && buttons[button]) {
+        releasedButtons[button] = true;
+    }
+    buttons[button] = down;
+}
+
+// Returns true if a key is down
+bool InputState::KeyDown(const SDL_Keycode key) const {
+    return KeyDown(KeyToScancode(key));
+}
+
+// Returns true if a key is down (scancodes)
+bool InputState::KeyDown(const SDL_Scancode key) const {
+    // A key is down if it's down, period
+    return TestKey(keys, key);
+}
+
+// Returns true if a key is down (modifiers)
+bool InputState::KeyDown(const SDL_Keymod key) const {
+    return (mods & key) > 0;
+}
+
+// Returns true if a key is up
+bool InputState::KeyUp(const SDL_Keycode key) const {
+    return KeyUp(KeyToScancode(key));
+}
+
+// Returns true if a key is up (scancodes)
+bool InputState::KeyUp(const SDL_Scancode key) const {
+    // A key is up if it is simply not down THIS frame
+    return !TestKey(keys, key);
+}
+
+// Returns true if a key is down (modifiers)
+bool InputState::KeyUp(const SDL_Keymod key) const {
+    return (mods & key) == 0;
+}
+
+// Returns true if a key is pressed
+bool InputState::KeyPressed(const SDL_Keycode key) const {
+    return KeyPressed(KeyToScancode(key));
+}
+
+// Returns true if a key is pressed (scancodes)
+bool InputState::KeyPressed(const SDL_Scancode key) const {
+    // A key is PRESSED if it went down at some point this frame (even if it's already back up)
+    return TestKey(pressedKeys, key);
+}
+
+// Returns true if a key is pressed (modifiers)
+bool InputState::KeyPressed(const SDL_Keymod key) const {
+   return (((mods & key) > 0) && ((prevMods & key) == 0));
+}
+
+// Returns true if a key is released
+bool InputState::KeyReleased(const SDL_Keycode key) const {
+    return KeyReleased(KeyToScancode(key));
+}
+
+// Returns true if a key is released (scancodes)
+bool InputState::KeyReleased(const SDL_Scancode key) const {
+    // A key is considered RELEASED if it came up at some point this frame
+    return TestKey(releasedKeys, key);
+}
+
+// Returns true if a key is released (modifiers)
+bool InputState::KeyReleased(const SDL_Keymod key) const {
+    return (((mods & key) == 0) && ((prevMods & key) > 0));
+}
+
+// Returns true if a button is down
+bool InputState::ButtonDown(const int button) const {
+    if (button < NUMBUTTONS) {
+        return buttons[button];
+    }
+    return false;
+}
+
+// Returns true if a button is up
+bool InputState::ButtonUp(const int button) const {
+    if (button < NUMBUTTONS) {
+        return !buttons[button];
+    }
+    return true;
+}
+
+// Returns true if a button is pressed
+bool InputState::ButtonPressed(const int button) const {
+    if (button < NUMBUTTONS) {
+        return pressedButtons[button];
+    }
+    return false;
+}
+
+// Returns true if a button is released
+bool InputState::ButtonReleased(const int button) const {
+    if (button < NUMBUTTONS) {
+        return releasedButtons[button];
+    }
+    return true;
+}
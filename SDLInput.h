@@ -1,151 +1,523 @@
-#ifndef SDLINPUT_H_
-#define SDLINPUT_H_
-
-// Defines
-#define NUMBUTTONS 6
-
-// Includes
-#include <SDL_events.h>
-#include <map>
-using std::map;
-
-struct MousePos {
-   int x;
-   int y;
-};
-
-class SDLInput
-{
-private:
-   // The control event
-   SDL_Event controlEvent;
-   
-   // The keys
-   //bool keys[NUMKEYS];
-   map<SDL_Keycode, bool> keys;
-   
-   // The keys last frame
-   //bool prevKeys[NUMKEYS];
-   map<SDL_Keycode, bool> prevKeys;
-
-   // If any key was pressed
-   bool anyKeyDown;
-   bool anyKeyPress;
-   bool anyKeyRelease;
-
-   // Keyboard modifiers (shift, control, alt)
-   Uint16 mods;
-
-   // Keyboard modifiers last frame
-   Uint16 prevMods;
-
-   // The mouse buttons
-   bool buttons[NUMBUTTONS];
-
-   // The mouse buttons last frame
-   bool prevButtons[NUMBUTTONS];
-
-   // True if double clicked, else false
-   bool doubleClicked;
-
-   // Mouse coords, relative to window (0,0) = TL corner
-   MousePos mousePos;
-
-   // Did we get the quit event
-   bool quit;
-
-   // Constructor
-   SDLInput();
-
-   // Copy constructor
-   SDLInput(const SDLInput& rhs) {};
-   
-   // Assignment operator
-   SDLInput& operator=(const SDLInput& rhs) { return *this; };
-
-   // Sets a key to the status of "pressed"
-   void UpdateKeyPress(SDL_KeyboardEvent* keyEvent);
-
-   // Sets a key to the status of "released"
-   void UpdateKeyRelease(SDL_KeyboardEvent* keyEvent);
-
-   // Sets a button to the status of "pressed"
-   void UpdateMousePress(SDL_MouseButtonEvent* mouseEvent);
-
-   // Sets a button to the status of "released"
-   void UpdateMouseRelease(SDL_MouseButtonEvent* mouseEvent);
-
-   // Update the mouse position
-   void UpdateMousePosition(SDL_MouseMotionEvent* mouseEvent);
-public:
-   // Destructor
-   ~SDLInput();
-
-   // Instance
-   static SDLInput* Instance();
-
-   // Initializes the Input
-   void Init();
-
-   // Shuts down the input
-   void Shutdown();
-
-   // Updates the controls
-   void Update();
-
-   // Returns true if a key is down
-   bool KeyDown(const SDL_Keycode key) const;
-
-   // Returns true if a key is down (modifiers)
-   bool KeyDown(const SDL_Keymod key) const;
-
-   // Returns true if a key is up
-   bool KeyUp(const SDL_Keycode key) const;
-
-   // Returns true if a key is down (modifiers)
-   bool KeyUp(const SDL_Keymod key) const;
-
-   // Returns true if a key is pressed
-   bool KeyPressed(const SDL_Keycode key) const;
-
-   // Returns true if a key is pressed (modifiers)
-   bool KeyPressed(const SDL_Keymod key) const;
-
-   // Returns true if a key is released
-   bool KeyReleased(const SDL_Keycode key) const;
-
-   // Returns true if a key is released (modifiers)
-   bool KeyReleased(const SDL_Keymod key) const;
-
-   // Returns true if a button is down
-   bool ButtonDown(const int button) const;
-
-   // Returns true if a button is up
-   bool ButtonUp(const int button) const;
-   
-   // Returns true if a button is pressed
-   bool ButtonPressed(const int button) const;
-
-   // Returns true if a button is released
-   bool ButtonReleased(const int button) const;
-
-   // Returns true if this was a double click
-   bool IsDoubleClick() const { return doubleClicked; }
-
-   // Returns the mouse position
-   MousePos GetMousePos() const { return mousePos; }
-
-   // Returns true if the SDL_QUIT event was heard
-   bool Quit() const { return quit; }
-
-   // Returns true if any key was pressed
-   bool AnyKeyPressed() const { return anyKeyPress; }
-
-   // Returns true if any key was down
-   bool AnyKeyDown() const { return anyKeyDown; }
-
-   // Returns true if any key was released
-   bool AnyKeyRelease() const { return anyKeyRelease; }
-};
-
+#ifndef SDLINPUT_H_
+#define SDLINPUT_H_
+
+// Defines
+#define NUMBUTTONS 6
+#define NUMKEYWORDS (SDL_NUM_SCANCODES / 64)
+#define EVENTBATCH 64
+#define EVENTHISTORY 256
+#define MOUSESAMPLES 64
+#define MAXCONTROLLERS 8
+
+// Includes
+#include <vector>
+#include <SDL_events.h>
+#include <SDL_gamecontroller.h>
+#include "SDLRecording.h"
+#include "SDLActions.h"
+
+// Called when a key or button goes down (pressed = true) or up, or on quit. Code is the
+// keycode or button it was added with.
+typedef void (*InputListener)(const int code, const bool pressed, void* userData);
+
+struct MousePos {
+   int x;
+   int y;
+};
+
+// An event the controls used, and when
+struct TimedEvent {
+   // SDL_EventType
+   Uint32 type;
+   // Scancode for keys, button for mouse buttons, otherwise 0
+   Sint32 code;
+   // Update it was handled in
+   Uint32 frame;
+   // SDL's timestamp (milliseconds, when it was queued)
+   Uint32 timestamp;
+   // Performance counter when it was handled
+   Uint64 handled;
+   // Performance counter estimate of when it was queued (pass this to SDLWindow::TrackInput)
+   Uint64 origin;
+};
+
+// Everything the controls know about one frame. SDLInput fills it in, and
+// Snapshot() hands out a copy that can be read on another thread.
+class InputState
+{
+protected:
+   // The keys, one bit per scancode
+   Uint64 keys[NUMKEYWORDS];
+
+   // The keys that went down/up this frame (both can be set if it was a quick tap)
+   Uint64 pressedKeys[NUMKEYWORDS];
+   Uint64 releasedKeys[NUMKEYWORDS];
+
+   // If any key was pressed
+   bool anyKeyDown;
+   bool anyKeyPress;
+   bool anyKeyRelease;
+
+   // Keyboard modifiers (shift, control, alt)
+   Uint16 mods;
+
+   // Keyboard modifiers last frame
+   Uint16 prevMods;
+
+   // The mouse buttons
+   bool buttons[NUMBUTTONS];
+
+   // The mouse buttons that went down/up this frame
+   bool pressedButtons[NUMBUTTONS];
+   bool releasedButtons[NUMBUTTONS];
+
+   // True if double clicked, else false
+   bool doubleClicked;
+
+   // Mouse coords, relative to window (0,0) = TL corner (logical coords if the window uses them)
+   MousePos mousePos;
+
+   // How far the mouse moved this frame (window pixels, works in relative mode too)
+   MousePos mouseDelta;
+
+   // How far the wheel turned this frame (positive y is away from the user)
+   MousePos mouseWheel;
+
+   // Did we get the quit event
+   bool quit;
+
+   // Game controllers, one bit per SDL_GameControllerButton, plus the ones that went down/up this frame
+   bool padConnected[MAXCONTROLLERS];
+   Uint32 padButtons[MAXCONTROLLERS];
+   Uint32 pressedPadButtons[MAXCONTROLLERS];
+   Uint32 releasedPadButtons[MAXCONTROLLERS];
+
+   // Controller axes after the deadzone, -1 to 1 (triggers 0 to 1)
+   float padAxes[MAXCONTROLLERS][SDL_CONTROLLER_AXIS_MAX];
+
+   // Bound actions that are down, and the ones that went down/up this frame
+   Uint64 actions[ACTIONWORDS];
+   Uint64 pressedActions[ACTIONWORDS];
+   Uint64 releasedActions[ACTIONWORDS];
+
+   // Wipes out everything
+   void Reset();
+
+   // Returns true if a scancode's bit is set
+   static bool TestKey(const Uint64* bits, const int scancode) {
+      return (unsigned)scancode < SDL_NUM_SCANCODES && ((bits[scancode >> 6] >> (scancode & 63)) & 1) != 0;
+   }
+
+   // Returns true if an action's bit is set
+   static bool TestAction(const Uint64* bits, const int action) {
+      return (unsigned)action < MAXACTIONS && ((bits[action >> 6] >> (action & 63)) & 1) != 0;
+   }
+
+   // Returns true if a controller button's bit is set
+   static bool TestPadButton(const Uint32* bits, const int pad, const int button) {
+      return (unsigned)pad < MAXCONTROLLERS && (unsigned)button < 32 && ((bits[pad] >> button) & 1) != 0;
+   }
+
+public:
+   // Constructor
+   InputState();
+
+   // Turns a keycode into the scancode its state is stored under
+   static SDL_Scancode KeyToScancode(const SDL_Keycode key);
+
+   // Returns true if a key is down
+   bool KeyDown(const SDL_Keycode key) const;
+
+   // Returns true if a key is down (scancodes)
+   bool KeyDown(const SDL_Scancode key) const;
+
+   // Returns true if a key is down (modifiers)
+   bool KeyDown(const SDL_Keymod key) const;
+
+   // Returns true if a key is up
+   bool KeyUp(const SDL_Keycode key) const;
+
+   // Returns true if a key is up (scancodes)
+   bool KeyUp(const SDL_Scancode key) const;
+
+   // Returns true if a key is down (modifiers)
+   bool KeyUp(const SDL_Keymod key) const;
+
+   // Returns true if a key is pressed
+   bool KeyPressed(const SDL_Keycode key) const;
+
+   // Returns true if a key is pressed (scancodes)
+   bool KeyPressed(const SDL_Scancode key) const;
+
+   // Returns true if a key is pressed (modifiers)
+   bool KeyPressed(const SDL_Keymod key) const;
+
+   // Returns true if a key is released
+   bool KeyReleased(const SDL_Keycode key) const;
+
+   // Returns true if a key is released (scancodes)
+   bool KeyReleased(const SDL_Scancode key) const;
+
+   // Returns true if a key is released (modifiers)
+   bool KeyReleased(const SDL_Keymod key) const;
+
+   // Returns true if there's a controller in this slot (0 to MAXCONTROLLERS - 1)
+   bool PadConnected(const int pad) const { return (unsigned)pad < MAXCONTROLLERS && padConnected[pad]; }
+
+   // Returns true if a controller button is down
+   bool PadButtonDown(const int pad, const SDL_GameControllerButton button) const {
+      return TestPadButton(padButtons, pad, button);
+   }
+
+   // Returns true if a controller button is up
+   bool PadButtonUp(const int pad, const SDL_GameControllerButton button) const {
+      return !TestPadButton(padButtons, pad, button);
+   }
+
+   // Returns true if a controller button went down this frame
+   bool PadButtonPressed(const int pad, const SDL_GameControllerButton button) const {
+      return TestPadButton(pressedPadButtons, pad, button);
+   }
+
+   // Returns true if a controller button came up this frame
+   bool PadButtonReleased(const int pad, const SDL_GameControllerButton button) const {
+      return TestPadButton(releasedPadButtons, pad, button);
+   }
+
+   // Returns true if any button on a controller went down this frame
+   bool AnyPadButtonPressed(const int pad) const { return (unsigned)pad < MAXCONTROLLERS && pressedPadButtons[pad] != 0; }
+
+   // Returns a controller axis, -1 to 1 for sticks, 0 to 1 for triggers, 0 inside the deadzone
+   float PadAxis(const int pad, const SDL_GameControllerAxis axis) const {
+      return ((unsigned)pad < MAXCONTROLLERS && (unsigned)axis < SDL_CONTROLLER_AXIS_MAX ? padAxes[pad][axis] : 0.0f);
+   }
+
+   // Returns the keyboard modifiers being held
+   Uint16 Mods() const { return mods; }
+
+   // Returns true if a bound action is down
+   bool ActionDown(const int action) const { return TestAction(actions, action); }
+
+   // Returns true if a bound action went down this frame
+   bool ActionPressed(const int action) const { return TestAction(pressedActions, action); }
+
+   // Returns true if a bound action came up this frame
+   bool ActionReleased(const int action) const { return TestAction(releasedActions, action); }
+
+   // Returns true if a button is down
+   bool ButtonDown(const int button) const;
+
+   // Returns true if a button is up
+   bool ButtonUp(const int button) const;
+
+   // Returns true if a button is pressed
+   bool ButtonPressed(const int button) const;
+
+   // Returns true if a button is released
+   bool ButtonReleased(const int button) const;
+
+   // Returns true if this was a double click
+   bool IsDoubleClick() const { return doubleClicked; }
+
+   // Returns the mouse position
+   MousePos GetMousePos() const { return mousePos; }
+
+   // Returns how far the mouse moved this frame
+   MousePos GetMouseDelta() const { return mouseDelta; }
+
+   // Returns how far the mouse wheel turned this frame
+   MousePos GetMouseWheel() const { return mouseWheel; }
+
+   // Returns true if the SDL_QUIT event was heard
+   bool Quit() const { return quit; }
+
+   // Returns true if any key was pressed
+   bool AnyKeyPressed() const { return anyKeyPress; }
+
+   // Returns true if any key was down
+   bool AnyKeyDown() const { return anyKeyDown; }
+
+   // Returns true if any key was released
+   bool AnyKeyRelease() const { return anyKeyRelease; }
+};
+
+class SDLWindow;
+
+class SDLInput : public InputState
+{
+private:
+   // The window mouse positions are relative to and that gets marked dirty
+   SDLWindow* display;
+
+   // Whether Init started the controllers
+   bool started;
+
+   // A subscribed callback
+   struct Listener {
+      InputListener callback;
+      void* userData;
+      int code;
+   };
+
+   // Listener tables, one per scancode, one per button and one for quit. Only the
+   // tables for keys that changed this frame get looked at.
+   std::vector<Listener> keyListeners[SDL_NUM_SCANCODES];
+   std::vector<Listener> buttonListeners[NUMBUTTONS];
+   std::vector<Listener> quitListeners;
+   Uint64 listenedKeys[NUMKEYWORDS];
+   bool quitThisFrame;
+
+   // The control event
+   SDL_Event controlEvent;
+
+   // Events pulled off the queue a batch at a time
+   SDL_Event eventBatch[EVENTBATCH];
+
+   // Stats for the last update
+   int eventCount;
+   float updateTime;
+   Uint64 frameStart;
+
+   // Key/button to action bindings
+   InputActions actionMap;
+
+   // The open controllers and their raw axes (the deadzone is applied once per update)
+   SDL_GameController* controllers[MAXCONTROLLERS];
+   SDL_JoystickID controllerIds[MAXCONTROLLERS];
+   Sint16 rawAxes[MAXCONTROLLERS][SDL_CONTROLLER_AXIS_MAX];
+   bool axesChanged[MAXCONTROLLERS];
+   int deadzone;
+
+   // Mouse motion is added up as it arrives and applied once (or before a button event)
+   bool motionPending;
+   MousePos motionPos;
+   Uint32 motionState;
+
+   // Keys that went down this frame, in order (for action sequences)
+   KeyPress framePresses[MAXFRAMEPRESSES];
+   int framePressCount;
+
+   // Pad events from InjectPadEvent, waiting for the next update
+   std::vector<SDL_Event> injectedEvents;
+
+   // Optional path the mouse took this frame
+   bool keepMouseSamples;
+   MousePos mouseSamples[MOUSESAMPLES];
+   int mouseSampleCount;
+
+   // The last EVENTHISTORY events, and where this frame's start
+   TimedEvent history[EVENTHISTORY];
+   Uint32 historyCount;
+   Uint32 frameFirstEvent;
+   Uint32 frameNumber;
+   Uint32 frameTicks;
+
+   // Timestamp of the newest input event (the recorded ones while replaying), actions are timed by it
+   Uint32 eventTime;
+
+   // Adds an event to the history
+   void RememberEvent(const SDL_Event& event);
+
+   // Recording and replaying, frames are counted from when either started
+   InputRecorder recorder;
+   InputReplayer replayer;
+   Uint32 recordFrame;
+
+   // Constructor
+   SDLInput();
+
+   // Copy constructor
+   SDLInput(const SDLInput& rhs) {};
+
+   // Assignment operator
+   SDLInput& operator=(const SDLInput& rhs) { return *this; };
+
+   // Clears this frame's edges
+   void BeginFrame();
+
+   // Handles every event in the queue
+   void DrainEvents();
+
+   // Swaps an event's controller id for the slot, then records (or while replaying, filters out) and applies it
+   void ConsumeEvent(SDL_Event& event);
+
+   // The same for an event whose controller events already carry the pad slot
+   void ConsumeSlotEvent(SDL_Event& event);
+
+   // Applies the events InjectPadEvent queued
+   void InjectedEvents();
+
+   // Applies one event
+   void HandleEvent(SDL_Event& event);
+
+   // Applies the recorded events for this frame
+   void ReplayEvents();
+
+   // Works out the "any key" flags
+   void EndFrame();
+
+   // Adds a listener to a table, returns the handle
+   int AddListener(std::vector<Listener>& table, const int tableIndex, InputListener callback, void* userData,
+      const int code);
+
+   // Calls the listeners for everything that changed this frame
+   void DispatchListeners();
+
+   // Calls every listener in a table for the edges that happened
+   static void CallListeners(const std::vector<Listener>& table, const bool pressed, const bool released,
+      const bool downNow);
+
+   // Refreshes the keycode to scancode table (the keyboard layout changed)
+   void UpdateKeymap();
+
+   // Sets a key to the status of "pressed"
+   void UpdateKeyPress(SDL_KeyboardEvent* keyEvent);
+
+   // Sets a key to the status of "released"
+   void UpdateKeyRelease(SDL_KeyboardEvent* keyEvent);
+
+   // Sets a button to the status of "pressed"
+   void UpdateMousePress(SDL_MouseButtonEvent* mouseEvent);
+
+   // Sets a button to the status of "released"
+   void UpdateMouseRelease(SDL_MouseButtonEvent* mouseEvent);
+
+   // Update the mouse position
+   void UpdateMousePosition(SDL_MouseMotionEvent* mouseEvent);
+
+   // Applies the added up mouse motion
+   void FlushMouseMotion();
+
+   // Adds up the mouse wheel
+   void UpdateMouseWheel(SDL_MouseWheelEvent* wheelEvent);
+
+   // Opens a controller that was plugged in, returns its slot (-1 if it's already open or there's no room)
+   int AddController(const int deviceIndex);
+
+   // Closes a controller that was unplugged, returns the slot it was in (-1 if it wasn't open)
+   int RemoveController(const SDL_JoystickID id);
+
+   // Finds the slot for a controller, -1 if it isn't open
+   int ControllerSlot(const SDL_JoystickID id) const;
+
+   // Opens or closes the controller behind a controller event and swaps its instance id (or device
+   // index) for the slot, so recordings and replays don't depend on the order things were plugged in.
+   // Returns false if the event isn't for a controller we have.
+   bool PadEventToSlot(SDL_Event& event);
+
+   // Shows a pad as plugged in with nothing held
+   void ConnectPad(const int slot);
+
+   // Shows a pad as unplugged, letting go of anything held
+   void DisconnectPad(const int slot);
+
+   // Sets a controller button up or down, remembering the edge
+   void UpdatePadButton(const int slot, const Uint8 button, const Uint8 state);
+
+   // Makes the pads match the controllers that are really plugged in (after a replay)
+   void SyncPads();
+
+   // Applies the deadzone to the axes that moved
+   void UpdatePadAxes();
+
+   // Sets a button up or down, remembering the edge
+   void SetButton(const int button, const bool down);
+public:
+   // Destructor
+   ~SDLInput();
+
+   // Instance
+   static SDLInput* Instance();
+
+   // Initializes the Input
+   void Init();
+
+   // Shuts down the input
+   void Shutdown();
+
+   // Sets the window input is for (nullptr for the default one). There's only one event queue,
+   // so there's only one SDLInput, but it can follow whichever window has the game in it.
+   void AttachWindow(SDLWindow* window);
+
+   // Updates the controls (handles every event waiting in the queue)
+   void Update();
+
+   // Idle version of Update. Sleeps until an event arrives, SDLWindow::MarkDirty is called
+   // or timeoutMs runs out (-1 waits forever). Returns false if it timed out.
+   bool WaitUpdate(const int timeoutMs = -1);
+
+   // The action bindings, evaluated at the end of every update
+   InputActions& Actions() { return actionMap; }
+
+   // Calls back when a key goes down or up (listeners are picked by scancode, so add them after Init)
+   int AddKeyListener(const SDL_Keycode key, InputListener callback, void* userData = nullptr);
+
+   // Calls back when a mouse button goes down or up
+   int AddButtonListener(const int button, InputListener callback, void* userData = nullptr);
+
+   // Calls back when the quit event is heard
+   int AddQuitListener(InputListener callback, void* userData = nullptr);
+
+   // Removes a listener (safe to call from inside one)
+   void RemoveListener(const int handle);
+
+   // Starts writing every event the controls use to a file
+   bool StartRecording(const char* fileName);
+
+   // Stops recording
+   void StopRecording();
+
+   // Plays a recording back instead of the real controls (quit still works). Nothing
+   // waits on the clock, so it runs as fast as the game loop does.
+   bool StartReplay(const char* fileName);
+
+   // Goes back to the real controls
+   void StopReplay();
+
+   // Returns true if recording
+   bool Recording() const { return recorder.IsOpen(); }
+
+   // Returns true if replaying
+   bool Replaying() const { return replayer.IsOpen(); }
+
+   // Returns true once the whole recording has been played
+   bool ReplayFinished() const { return replayer.Finished(recordFrame); }
+
+   // Feeds in a controller event by pad slot (which is the slot for every type, SDL_CONTROLLERDEVICEADDED
+   // included), the same way a replay does. No controller has to exist, so tests and tools can drive the
+   // pads without hardware. It's applied (and recorded) on the next update, like a real one.
+   void InjectPadEvent(const SDL_Event& event);
+
+   // Stick/trigger values closer to the middle than this (0 to 32767) read as 0
+   void ControllerDeadzone(const int deadzone);
+   int ControllerDeadzone() const { return deadzone; }
+
+   // The SDL controller in a slot, nullptr if there isn't one
+   SDL_GameController* Controller(const int pad) const { return ((unsigned)pad < MAXCONTROLLERS ? controllers[pad] : nullptr); }
+
+   // Hides the cursor and reports only relative motion (for mouse look)
+   void RelativeMouseMode(const bool relative);
+   bool RelativeMouseMode() const;
+
+   // Keeps every mouse position from each update (up to MOUSESAMPLES) for drawing smooth paths
+   void KeepMouseSamples(const bool keep) { keepMouseSamples = keep; mouseSampleCount = 0; }
+   int MouseSampleCount() const { return mouseSampleCount; }
+   MousePos MouseSample(const int index) const { return mouseSamples[index]; }
+
+   // Number of events kept from the last update (at most EVENTHISTORY)
+   int FrameEventCount() const;
+
+   // Returns one of the events from the last update, oldest first
+   const TimedEvent& FrameEvent(const int index) const;
+
+   // Number of events handled by the last update
+   int EventCount() const { return eventCount; }
+
+   // How long the last update took, in milliseconds
+   float UpdateTime() const { return updateTime; }
+
+   // Returns a copy of this frame's controls that won't change when Update is called again
+   InputState Snapshot() const { return InputState(*this); }
+};
+
 #endif // SLDINPUT_H_
\ No newline at end of file
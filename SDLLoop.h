@@ -0,0 +1,196 @@
+#ifndef SDLLOOP_H_
+#define SDLLOOP_H_
+
+// Includes
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <SDL.h>
+#include "SDLWindow.h"
+#include "SDLInput.h"
+
+// Runs the game's update for frame N+1 on a worker thread while the main thread
+// renders frame N, so a frame costs max(update, render) instead of their sum.
+//
+// The State is double buffered. While a frame is in flight the render function
+// reads the front state and the update function reads the same front state and
+// writes the back one, so neither ever sees a half written state. The update
+// runs on the worker thread and must only use the InputState it is handed, never
+// the SDL singletons.
+template <class State>
+class SDLPipelinedLoop {
+public:
+   // Builds the next state from the previous one
+   typedef void (*UpdateFunc)(const State& previous, State& next, const InputState& controls,
+      float deltaTime, void* userData);
+
+   // Draws a state (SDLWindow::Clear and Present are done for you)
+   typedef void (*RenderFunc)(const State& state, void* userData);
+
+private:
+   // The two copies of the game state, and which one is being shown
+   State states[2];
+   int front;
+
+   // The controls handed to the worker for the frame it is simulating
+   InputState controls;
+   float deltaTime;
+
+   // The frame the worker has been asked for and the last one it finished (both guarded
+   // by frameLock). The main thread only touches controls/back state while they are equal.
+   Uint32 requestedFrame;
+   Uint32 finishedFrame;
+   std::atomic<bool> running;
+
+   // The worker sleeps on frameRequested, the main thread on frameFinished
+   std::mutex frameLock;
+   std::condition_variable frameRequested;
+   std::condition_variable frameFinished;
+
+   // What the user wants run
+   UpdateFunc update;
+   RenderFunc render;
+   void* userData;
+
+   // Timings of the last frame, in milliseconds
+   float updateMs;
+   float renderMs;
+   float frameMs;
+   float workerUpdateMs;
+
+   // Copy Constructor
+   SDLPipelinedLoop(const SDLPipelinedLoop& rhs) {};
+
+   // Assignment Operator
+   SDLPipelinedLoop& operator=(const SDLPipelinedLoop& rhs) { return *this; }
+
+   // Milliseconds between two performance counter values
+   static float Milliseconds(Uint64 start, Uint64 end) {
+      return (float)((end - start) * 1000.0 / SDL_GetPerformanceFrequency());
+   }
+
+   // Sleeps until the worker finished the frame
+   void WaitForWorker(Uint32 frame) {
+      std::unique_lock<std::mutex> lock(frameLock);
+      while (finishedFrame != frame) {
+         frameFinished.wait(lock);
+      }
+   }
+
+   // Hands the worker a frame to simulate
+   void RequestFrame(Uint32 frame) {
+      {
+         std::lock_guard<std::mutex> lock(frameLock);
+         requestedFrame = frame;
+      }
+      frameRequested.notify_one();
+   }
+
+   // The worker thread, simulates each frame it is asked for
+   void Worker() {
+      Uint32 lastFrame = 0;
+      for (;;) {
+         // Sleep until there's a frame to do. Stopping only ends the thread once every
+         // requested frame is finished, or the main thread would wait on it forever.
+         Uint32 frame = 0;
+         {
+            std::unique_lock<std::mutex> lock(frameLock);
+            while (requestedFrame == lastFrame && running.load(std::memory_order_relaxed)) {
+               frameRequested.wait(lock);
+            }
+            frame = requestedFrame;
+         }
+         if (frame == lastFrame) {
+            return;
+         }
+
+         // Front is read only while a frame is in flight, back is ours
+         Uint64 start = SDL_GetPerformanceCounter();
+         update(states[front], states[front ^ 1], controls, deltaTime, userData);
+         workerUpdateMs = Milliseconds(start, SDL_GetPerformanceCounter());
+
+         // Hand it back
+         lastFrame = frame;
+         {
+            std::lock_guard<std::mutex> lock(frameLock);
+            finishedFrame = frame;
+         }
+         frameFinished.notify_one();
+      }
+   }
+
+public:
+   // Constructor
+   SDLPipelinedLoop() : front(0), deltaTime(0.0f), requestedFrame(0), finishedFrame(0), running(false),
+      update(nullptr), render(nullptr), userData(nullptr), updateMs(0.0f), renderMs(0.0f), frameMs(0.0f),
+      workerUpdateMs(0.0f) {}
+
+   // Runs until the quit event is heard or Stop is called. SDLWindow and SDLInput must be initialized.
+   void Run(const State& initial, UpdateFunc update, RenderFunc render, void* userData = nullptr) {
+      this->update = update;
+      this->render = render;
+      this->userData = userData;
+      states[0] = initial;
+      states[1] = initial;
+      front = 0;
+      requestedFrame = 0;
+      finishedFrame = 0;
+      running.store(true, std::memory_order_relaxed);
+
+      std::thread worker(&SDLPipelinedLoop::Worker, this);
+
+      Uint32 frame = 0;
+      Uint64 lastFrameStart = SDL_GetPerformanceCounter();
+      while (running.load(std::memory_order_relaxed)) {
+         Uint64 frameStart = SDL_GetPerformanceCounter();
+
+         // The worker is idle here, so it's safe to hand it new controls
+         SDLInput::Instance()->Update();
+         if (SDLInput::Instance()->Quit()) {
+            Stop();
+            break;
+         }
+         controls = SDLInput::Instance()->Snapshot();
+         deltaTime = Milliseconds(lastFrameStart, frameStart) * 0.001f;
+         lastFrameStart = frameStart;
+
+         // Start simulating the next frame
+         ++frame;
+         RequestFrame(frame);
+
+         // Meanwhile, draw this one
+         Uint64 renderStart = SDL_GetPerformanceCounter();
+         SDLWindow::Instance()->Clear();
+         render(states[front], userData);
+         SDLWindow::Instance()->Present();
+         renderMs = Milliseconds(renderStart, SDL_GetPerformanceCounter());
+
+         // Both are done, the new state becomes the front
+         WaitForWorker(frame);
+         updateMs = workerUpdateMs;
+         front ^= 1;
+         frameMs = Milliseconds(frameStart, SDL_GetPerformanceCounter());
+      }
+
+      // The loop can also end on the first check, if Stop came from inside render
+      Stop();
+      worker.join();
+   }
+
+   // Asks Run to return after the current frame
+   void Stop() {
+      {
+         std::lock_guard<std::mutex> lock(frameLock);
+         running.store(false, std::memory_order_relaxed);
+      }
+      frameRequested.notify_one();
+   }
+
+   // Accessors (milliseconds, last frame)
+   float UpdateMs() const { return updateMs; }
+   float RenderMs() const { return renderMs; }
+   float FrameMs() const { return frameMs; }
+};
+
+#endif // SDLLOOP_H_
@@ -0,0 +1,105 @@
+#include "SDLMappedFile.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Constructor
+MappedFile::MappedFile()
+{
+   data = nullptr;
+   size = 0;
+#ifdef _WIN32
+   fileHandle = INVALID_HANDLE_VALUE;
+   mappingHandle = nullptr;
+#else
+   fileHandle = -1;
+#endif
+}
+
+// Destructor
+MappedFile::~MappedFile()
+{
+   Close();
+}
+
+// Maps a file
+bool MappedFile::Open(const char* fileName)
+{
+   Close();
+
+#ifdef _WIN32
+   fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+      FILE_ATTRIBUTE_NORMAL, nullptr);
+   if (fileHandle == INVALID_HANDLE_VALUE) {
+      return false;
+   }
+   LARGE_INTEGER fileSize;
+   if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+      Close();
+      return false;
+   }
+   mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+   if (!mappingHandle) {
+      Close();
+      return false;
+   }
+   data = (const Uint8*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+   if (!data) {
+      Close();
+      return false;
+   }
+   size = (size_t)fileSize.QuadPart;
+#else
+   fileHandle = open(fileName, O_RDONLY);
+   if (fileHandle == -1) {
+      return false;
+   }
+   struct stat info;
+   if (fstat(fileHandle, &info) != 0 || info.st_size == 0) {
+      Close();
+      return false;
+   }
+   void* view = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fileHandle, 0);
+   if (view == MAP_FAILED) {
+      Close();
+      return false;
+   }
+   data = (const Uint8*)view;
+   size = (size_t)info.st_size;
+#endif
+   return true;
+}
+
+// Unmaps the file
+void MappedFile::Close()
+{
+#ifdef _WIN32
+   if (data) {
+      UnmapViewOfFile(data);
+   }
+   if (mappingHandle) {
+      CloseHandle(mappingHandle);
+      mappingHandle = nullptr;
+   }
+   if (fileHandle != INVALID_HANDLE_VALUE) {
+      CloseHandle(fileHandle);
+      fileHandle = INVALID_HANDLE_VALUE;
+   }
+#else
+   if (data) {
+      munmap((void*)data, size);
+   }
+   if (fileHandle != -1) {
+      close(fileHandle);
+      fileHandle = -1;
+   }
+#endif
+   data = nullptr;
+   size = 0;
+}
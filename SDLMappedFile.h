@@ -0,0 +1,53 @@
+#ifndef SDLMAPPEDFILE_H_
+#define SDLMAPPEDFILE_H_
+
+// Includes
+#include <SDL.h>
+
+// A read only memory mapping of a whole file. The pages come straight from the OS file
+// cache, so nothing is copied when the file is opened and processes mapping the same
+// file share the memory.
+class MappedFile {
+private:
+   // The mapping
+   const Uint8* data;
+   size_t size;
+
+   // OS handles
+#ifdef _WIN32
+   void* fileHandle;
+   void* mappingHandle;
+#else
+   int fileHandle;
+#endif
+
+   // Copy Constructor
+   MappedFile(const MappedFile& rhs) {};
+
+   // Assignment Operator
+   MappedFile& operator=(const MappedFile& rhs) { return *this; }
+
+public:
+   // Constructor
+   MappedFile();
+
+   // Destructor
+   ~MappedFile();
+
+   // Maps a file, returns false if it couldn't be opened or mapped
+   bool Open(const char* fileName);
+
+   // Unmaps the file
+   void Close();
+
+   // Returns true if a file is mapped
+   bool IsOpen() const { return data != nullptr; }
+
+   // The mapped bytes
+   const Uint8* Data() const { return data; }
+
+   // How many bytes are mapped
+   size_t Size() const { return size; }
+};
+
+#endif // SDLMAPPEDFILE_H_
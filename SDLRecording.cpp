@@ -0,0 +1,447 @@
+#include "SDLRecording.h"
+#include <cstring>
+
+// File header (version 2 added RECORD_WHEEL, 3 the controller records)
+static const Uint8 recordingMagic[4] = { 'S', 'D', 'L', 'R' };
+static const Uint8 recordingVersion = 3;
+
+// Record types
+enum RecordType {
+   RECORD_KEYDOWN,
+   RECORD_KEYUP,
+   RECORD_BUTTONDOWN,
+   RECORD_BUTTONUP,
+   RECORD_MOTION,
+   RECORD_QUIT,
+   RECORD_WHEEL,
+   RECORD_PADADDED,
+   RECORD_PADREMOVED,
+   RECORD_PADBUTTON,
+   RECORD_PADAXIS,
+   RECORD_END = 255
+};
+
+// Recorder Constructor
+InputRecorder::InputRecorder()
+{
+   file = nullptr;
+   used = 0;
+   lastFrame = lastTime = 0;
+}
+
+// Recorder Destructor
+InputRecorder::~InputRecorder()
+{
+   Close(lastFrame);
+}
+
+// Starts a new recording
+bool InputRecorder::Open(const char* fileName)
+{
+   // Finish off any old one
+   Close(lastFrame);
+
+   file = SDL_RWFromFile(fileName, "wb");
+   if (!file) {
+      return false;
+   }
+
+   used = 0;
+   lastFrame = lastTime = 0;
+   for (int ii = 0; ii < 4; ++ii) {
+      PutByte(recordingMagic[ii]);
+   }
+   PutByte(recordingVersion);
+   return true;
+}
+
+// Finishes the recording
+void InputRecorder::Close(const Uint32 frameCount)
+{
+   if (!file) {
+      return;
+   }
+
+   // Mark how long the recording was
+   PutHeader(frameCount, lastTime, RECORD_END);
+   Flush();
+   SDL_RWclose(file);
+   file = nullptr;
+}
+
+// Records an event
+void InputRecorder::Record(const Uint32 frame, const SDL_Event& event)
+{
+   if (!file) {
+      return;
+   }
+
+   switch (event.type)
+   {
+      case SDL_KEYDOWN:
+      case SDL_KEYUP:
+      {
+         PutHeader(frame, event.key.timestamp, (event.type == SDL_KEYDOWN ? RECORD_KEYDOWN : RECORD_KEYUP));
+         PutUnsigned(event.key.keysym.scancode);
+         PutSigned(event.key.keysym.sym);
+         PutUnsigned(event.key.keysym.mod);
+         PutByte(event.key.repeat);
+         break;
+      }
+      case SDL_MOUSEBUTTONDOWN:
+      case SDL_MOUSEBUTTONUP:
+      {
+         PutHeader(frame, event.button.timestamp, (event.type == SDL_MOUSEBUTTONDOWN ? RECORD_BUTTONDOWN : RECORD_BUTTONUP));
+         PutByte(event.button.button);
+         PutByte(event.button.clicks);
+         PutSigned(event.button.x);
+         PutSigned(event.button.y);
+         break;
+      }
+      case SDL_MOUSEMOTION:
+      {
+         PutHeader(frame, event.motion.timestamp, RECORD_MOTION);
+         PutSigned(event.motion.x);
+         PutSigned(event.motion.y);
+         PutSigned(event.motion.xrel);
+         PutSigned(event.motion.yrel);
+         PutUnsigned(event.motion.state);
+         break;
+      }
+      case SDL_MOUSEWHEEL:
+      {
+         PutHeader(frame, event.wheel.timestamp, RECORD_WHEEL);
+         PutSigned(event.wheel.x);
+         PutSigned(event.wheel.y);
+         PutUnsigned(event.wheel.direction);
+         break;
+      }
+      case SDL_CONTROLLERDEVICEADDED:
+      case SDL_CONTROLLERDEVICEREMOVED:
+      {
+         PutHeader(frame, event.cdevice.timestamp, (event.type == SDL_CONTROLLERDEVICEADDED ? RECORD_PADADDED : RECORD_PADREMOVED));
+         PutUnsigned(event.cdevice.which);
+         break;
+      }
+      case SDL_CONTROLLERBUTTONDOWN:
+      case SDL_CONTROLLERBUTTONUP:
+      {
+         PutHeader(frame, event.cbutton.timestamp, RECORD_PADBUTTON);
+         PutUnsigned(event.cbutton.which);
+         PutByte(event.cbutton.button);
+         PutByte(event.cbutton.state);
+         break;
+      }
+      case SDL_CONTROLLERAXISMOTION:
+      {
+         PutHeader(frame, event.caxis.timestamp, RECORD_PADAXIS);
+         PutUnsigned(event.caxis.which);
+         PutByte(event.caxis.axis);
+         PutSigned(event.caxis.value);
+         break;
+      }
+      case SDL_QUIT:
+      {
+         PutHeader(frame, event.quit.timestamp, RECORD_QUIT);
+         break;
+      }
+      default:
+      {
+         break;
+      }
+   };
+}
+
+// Writes the part every record starts with
+void InputRecorder::PutHeader(const Uint32 frame, const Uint32 timestamp, const Uint8 type)
+{
+   PutUnsigned(frame - lastFrame);
+   // Timestamps should only go up, but don't trust them
+   PutUnsigned(SDL_TICKS_PASSED(timestamp, lastTime) ? timestamp - lastTime : 0);
+   PutByte(type);
+   lastFrame = frame;
+   if (SDL_TICKS_PASSED(timestamp, lastTime)) {
+      lastTime = timestamp;
+   }
+}
+
+// Writes a byte
+void InputRecorder::PutByte(const Uint8 value)
+{
+   if (used == RECORDINGBUFFER) {
+      Flush();
+   }
+   buffer[used++] = value;
+}
+
+// Writes 7 bits at a time, high bit set means there's more
+void InputRecorder::PutUnsigned(Uint32 value)
+{
+   while (value >= 0x80) {
+      PutByte((Uint8)(value | 0x80));
+      value >>= 7;
+   }
+   PutByte((Uint8)value);
+}
+
+// Zigzag encodes so small negative numbers stay small
+void InputRecorder::PutSigned(const Sint32 value)
+{
+   PutUnsigned(((Uint32)value << 1) ^ (Uint32)(value >> 31));
+}
+
+// Writes out the buffer
+void InputRecorder::Flush()
+{
+   if (file && used > 0) {
+      SDL_RWwrite(file, buffer, 1, used);
+   }
+   used = 0;
+}
+
+// Replayer Constructor
+InputReplayer::InputReplayer()
+{
+   file = nullptr;
+   used = size = 0;
+   pendingFrame = 0;
+   hasPending = false;
+   lastFrame = lastTime = 0;
+   endFrame = 0;
+   ended = false;
+}
+
+// Replayer Destructor
+InputReplayer::~InputReplayer()
+{
+   Close();
+}
+
+// Opens a recording
+bool InputReplayer::Open(const char* fileName)
+{
+   Close();
+
+   file = SDL_RWFromFile(fileName, "rb");
+   if (!file) {
+      return false;
+   }
+
+   used = size = 0;
+   hasPending = false;
+   lastFrame = lastTime = 0;
+   endFrame = 0;
+   ended = false;
+
+   // Make sure it's one of ours
+   for (int ii = 0; ii < 4; ++ii) {
+      Uint8 value = 0;
+      if (!GetByte(value) || value != recordingMagic[ii]) {
+         Close();
+         return false;
+      }
+   }
+   Uint8 version = 0;
+   if (!GetByte(version) || version != recordingVersion) {
+      Close();
+      return false;
+   }
+   return true;
+}
+
+// Closes the recording
+void InputReplayer::Close()
+{
+   if (file) {
+      SDL_RWclose(file);
+      file = nullptr;
+   }
+   hasPending = false;
+}
+
+// Gets the next event recorded on this frame
+bool InputReplayer::Next(const Uint32 frame, SDL_Event& event)
+{
+   if (!hasPending && !ended) {
+      hasPending = ReadRecord();
+   }
+
+   // Nothing left, or it belongs to a later frame
+   if (!hasPending || pendingFrame > frame) {
+      return false;
+   }
+
+   event = pending;
+   hasPending = false;
+   return true;
+}
+
+// Reads the next record into pending
+bool InputReplayer::ReadRecord()
+{
+   Uint32 frameDelta = 0;
+   Uint32 timeDelta = 0;
+   Uint8 type = RECORD_END;
+   if (!GetUnsigned(frameDelta) || !GetUnsigned(timeDelta) || !GetByte(type)) {
+      // Cut off recording, stop where it stopped
+      ended = true;
+      endFrame = lastFrame;
+      return false;
+   }
+   lastFrame += frameDelta;
+   lastTime += timeDelta;
+
+   memset(&pending, 0, sizeof(pending));
+   pendingFrame = lastFrame;
+   bool ok = true;
+   switch (type)
+   {
+      case RECORD_KEYDOWN:
+      case RECORD_KEYUP:
+      {
+         Uint32 scancode = 0;
+         Sint32 sym = 0;
+         Uint32 mod = 0;
+         Uint8 repeat = 0;
+         ok = GetUnsigned(scancode) && GetSigned(sym) && GetUnsigned(mod) && GetByte(repeat);
+         pending.type = (type == RECORD_KEYDOWN ? SDL_KEYDOWN : SDL_KEYUP);
+         pending.key.state = (type == RECORD_KEYDOWN ? SDL_PRESSED : SDL_RELEASED);
+         pending.key.repeat = repeat;
+         pending.key.keysym.scancode = (SDL_Scancode)scancode;
+         pending.key.keysym.sym = sym;
+         pending.key.keysym.mod = (Uint16)mod;
+         break;
+      }
+      case RECORD_BUTTONDOWN:
+      case RECORD_BUTTONUP:
+      {
+         Sint32 x = 0;
+         Sint32 y = 0;
+         ok = GetByte(pending.button.button) && GetByte(pending.button.clicks) && GetSigned(x) && GetSigned(y);
+         pending.type = (type == RECORD_BUTTONDOWN ? SDL_MOUSEBUTTONDOWN : SDL_MOUSEBUTTONUP);
+         pending.button.state = (type == RECORD_BUTTONDOWN ? SDL_PRESSED : SDL_RELEASED);
+         pending.button.x = x;
+         pending.button.y = y;
+         break;
+      }
+      case RECORD_MOTION:
+      {
+         Sint32 x = 0;
+         Sint32 y = 0;
+         Sint32 xrel = 0;
+         Sint32 yrel = 0;
+         Uint32 state = 0;
+         ok = GetSigned(x) && GetSigned(y) && GetSigned(xrel) && GetSigned(yrel) && GetUnsigned(state);
+         pending.type = SDL_MOUSEMOTION;
+         pending.motion.x = x;
+         pending.motion.y = y;
+         pending.motion.xrel = xrel;
+         pending.motion.yrel = yrel;
+         pending.motion.state = state;
+         break;
+      }
+      case RECORD_WHEEL:
+      {
+         Sint32 x = 0;
+         Sint32 y = 0;
+         ok = GetSigned(x) && GetSigned(y) && GetUnsigned(pending.wheel.direction);
+         pending.type = SDL_MOUSEWHEEL;
+         pending.wheel.x = x;
+         pending.wheel.y = y;
+         break;
+      }
+      case RECORD_PADADDED:
+      case RECORD_PADREMOVED:
+      {
+         Uint32 slot = 0;
+         ok = GetUnsigned(slot);
+         pending.type = (type == RECORD_PADADDED ? SDL_CONTROLLERDEVICEADDED : SDL_CONTROLLERDEVICEREMOVED);
+         pending.cdevice.which = (Sint32)slot;
+         break;
+      }
+      case RECORD_PADBUTTON:
+      {
+         Uint32 slot = 0;
+         ok = GetUnsigned(slot) && GetByte(pending.cbutton.button) && GetByte(pending.cbutton.state);
+         pending.type = (pending.cbutton.state == SDL_PRESSED ? SDL_CONTROLLERBUTTONDOWN : SDL_CONTROLLERBUTTONUP);
+         pending.cbutton.which = (SDL_JoystickID)slot;
+         break;
+      }
+      case RECORD_PADAXIS:
+      {
+         Uint32 slot = 0;
+         Sint32 value = 0;
+         ok = GetUnsigned(slot) && GetByte(pending.caxis.axis) && GetSigned(value);
+         pending.type = SDL_CONTROLLERAXISMOTION;
+         pending.caxis.which = (SDL_JoystickID)slot;
+         pending.caxis.value = (Sint16)value;
+         break;
+      }
+      case RECORD_QUIT:
+      {
+         pending.type = SDL_QUIT;
+         break;
+      }
+      default:
+      {
+         // END (or something we don't understand), the recording is over
+         ended = true;
+         endFrame = lastFrame;
+         return false;
+      }
+   };
+
+   if (!ok) {
+      ended = true;
+      endFrame = lastFrame;
+      return false;
+   }
+   pending.common.timestamp = lastTime;
+   return true;
+}
+
+// Reads a byte, refilling the buffer when it runs out
+bool InputReplayer::GetByte(Uint8& value)
+{
+   if (used == size) {
+      if (!file) {
+         return false;
+      }
+      size = (int)SDL_RWread(file, buffer, 1, RECORDINGBUFFER);
+      used = 0;
+      if (size <= 0) {
+         size = 0;
+         return false;
+      }
+   }
+   value = buffer[used++];
+   return true;
+}
+
+// Reads 7 bits at a time
+bool InputReplayer::GetUnsigned(Uint32& value)
+{
+   value = 0;
+   for (int shift = 0; shift < 35; shift += 7) {
+      Uint8 part = 0;
+      if (!GetByte(part)) {
+         return false;
+      }
+      value |= (Uint32)(part & 0x7F) << shift;
+      if ((part & 0x80) == 0) {
+         return true;
+      }
+   }
+   return false;
+}
+
+// Undoes the zigzag encoding
+bool InputReplayer::GetSigned(Sint32& value)
+{
+   Uint32 raw = 0;
+   if (!GetUnsigned(raw)) {
+      return false;
+   }
+   value = (Sint32)((raw >> 1) ^ (~(raw & 1) + 1));
+   return true;
+}
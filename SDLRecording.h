@@ -0,0 +1,122 @@
+#ifndef SDLRECORDING_H_
+#define SDLRECORDING_H_
+
+// Defines
+#define RECORDINGBUFFER 4096
+
+// Includes
+#include <SDL.h>
+
+// Recordings are a small header followed by one record per event:
+//   varint frames since the last record
+//   varint milliseconds since the last record
+//   byte   record type
+//   the fields that type needs (varints, signed ones zigzag encoded)
+// Controller records hold SDLInput's pad slot rather than SDL's instance id, which changes every run.
+// A final END record holds the number of frames that were recorded.
+
+// Writes the events SDLInput consumes (keys, mouse buttons, motion, wheel, controllers and quit) to a file as they happen
+class InputRecorder {
+private:
+   // The file and what hasn't been written to it yet
+   SDL_RWops* file;
+   Uint8 buffer[RECORDINGBUFFER];
+   int used;
+
+   // What the last record was relative to
+   Uint32 lastFrame;
+   Uint32 lastTime;
+
+   // Copy Constructor
+   InputRecorder(const InputRecorder& rhs) {};
+
+   // Assignment Operator
+   InputRecorder& operator=(const InputRecorder& rhs) { return *this; }
+
+   // Writers
+   void PutByte(const Uint8 value);
+   void PutUnsigned(Uint32 value);
+   void PutSigned(const Sint32 value);
+   void PutHeader(const Uint32 frame, const Uint32 timestamp, const Uint8 type);
+   void Flush();
+
+public:
+   // Constructor
+   InputRecorder();
+
+   // Destructor
+   ~InputRecorder();
+
+   // Starts a new recording, returns false if the file couldn't be opened
+   bool Open(const char* fileName);
+
+   // Finishes the recording (frameCount is how many frames it lasted)
+   void Close(const Uint32 frameCount);
+
+   // Records an event. Events the recording doesn't need are skipped.
+   void Record(const Uint32 frame, const SDL_Event& event);
+
+   // Returns true if recording
+   bool IsOpen() const { return file != nullptr; }
+};
+
+// Reads a recording back one frame at a time
+class InputReplayer {
+private:
+   // The file and what's been read from it
+   SDL_RWops* file;
+   Uint8 buffer[RECORDINGBUFFER];
+   int used;
+   int size;
+
+   // The next event and the frame it belongs to
+   SDL_Event pending;
+   Uint32 pendingFrame;
+   bool hasPending;
+
+   // What the next record is relative to
+   Uint32 lastFrame;
+   Uint32 lastTime;
+
+   // Frame the recording stops at, and whether we got there
+   Uint32 endFrame;
+   bool ended;
+
+   // Copy Constructor
+   InputReplayer(const InputReplayer& rhs) {};
+
+   // Assignment Operator
+   InputReplayer& operator=(const InputReplayer& rhs) { return *this; }
+
+   // Readers
+   bool GetByte(Uint8& value);
+   bool GetUnsigned(Uint32& value);
+   bool GetSigned(Sint32& value);
+
+   // Reads the next record into pending
+   bool ReadRecord();
+
+public:
+   // Constructor
+   InputReplayer();
+
+   // Destructor
+   ~InputReplayer();
+
+   // Opens a recording, returns false if it couldn't be opened or isn't a recording
+   bool Open(const char* fileName);
+
+   // Closes the recording
+   void Close();
+
+   // Gets the next event recorded on this frame, returns false when there are no more
+   bool Next(const Uint32 frame, SDL_Event& event);
+
+   // Returns true once every recorded frame has been played
+   bool Finished(const Uint32 frame) const { return file == nullptr || (ended && !hasPending && frame >= endFrame); }
+
+   // Returns true if replaying
+   bool IsOpen() const { return file != nullptr; }
+};
+
+#endif // SDLRECORDING_H_
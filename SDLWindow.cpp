@@ -1,137 +1,476 @@
-#include "SDLWindow.h"
-
-// Constructor
-SDLWindow::SDLWindow()
-{
-   screen = nullptr;
-   window = nullptr;
-   renderer = nullptr;
-}
-
-// Destructor
-SDLWindow::~SDLWindow()
-{
-   Shutdown();
-}
-
-// Gets an instance of the SDLWindow
-SDLWindow* SDLWindow::Instance()
-{
-   static SDLWindow myWindow;
-   return &myWindow;
-}
-
-// Initializes the window/video
-void SDLWindow::Init(const char* title, const int screenWidth, const int screenHeight,
-   const bool fullscreen, const bool vsync, const bool centerX, const bool centerY, const bool borderless,
-   const bool resizable)
-{
-   // Initialize SDL Video
-   SDL_Init(SDL_INIT_VIDEO);
-
-   // Setup screen settings
-   this->screenWidth = screenWidth;
-   this->screenHeight = screenHeight;
-   this->fullscreen = fullscreen;
-
-   // Set up display flags
-   Uint32 displayFlags = 0;
-   displayFlags |= (fullscreen ? SDL_WINDOW_FULLSCREEN : 0);
-   displayFlags |= (borderless ? SDL_WINDOW_BORDERLESS : 0);
-   displayFlags |= (resizable ? SDL_WINDOW_RESIZABLE : 0);
-
-   // Create the window
-   window = SDL_CreateWindow(title, //  Title of the window
-      (centerX ? SDL_WINDOWPOS_CENTERED : SDL_WINDOWPOS_UNDEFINED), // Centered on the X?
-      (centerY ? SDL_WINDOWPOS_CENTERED : SDL_WINDOWPOS_UNDEFINED), // Centered on the Y?
-      screenWidth, // Width of the screen
-      screenHeight, // Height of the screen
-      displayFlags); // All the flags set up earlier
-
-   // Create the Renderer
-   int renderVals = 0;
-   renderVals = renderVals | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
-   renderer = SDL_CreateRenderer(window, -1, renderVals);
-
-   // Get the screen
-   screen = SDL_GetWindowSurface(window);
-
-   // Default the background color to black
-   SetBackgroundColor();
-}
-
-void SDLWindow::Clear()
-{
-   // Clear the screen
-   SDL_RenderClear(renderer);
-}
-
-void SDLWindow::SetBackgroundColor(const int red, const int green, const int blue)
-{
-   // Set the background color
-   if (screen && screen->format) {
-      bgColor = SDL_MapRGB(screen->format, red, green, blue);
-   }
-   SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
-}
-
-// Cleans up and shuts down
-void SDLWindow::Shutdown()
-{
-   // Background back to black
-   SetBackgroundColor();
-
-   // Delete any existing screen
-   if (screen) {
-      SDL_FreeSurface(screen);
-      screen = nullptr;
-   }
-
-   // Delete any existing renderer
-   if (renderer) {
-      SDL_DestroyRenderer(renderer);
-      renderer = nullptr;
-   }
-
-   // Delete the window
-   if (window) {
-      SDL_DestroyWindow(window);
-      window = nullptr;
-   }
-
-   // Shutdown the video
-   SDL_QuitSubSystem(SDL_INIT_VIDEO);
-
-   // Shut it all down
-   SDL_Quit();
-}
-
-// Sets the fullscreen mode
-void SDLWindow::Fullscreen(const bool fullscreen)
-{
-   this->fullscreen = fullscreen;
-   SDL_SetWindowFullscreen(window, (fullscreen ? SDL_WINDOW_FULLSCREEN : 0));
-}
-
-// Changes the screen resolution
-void SDLWindow::Resolution(const int screenWidth, const int screenHeight)
-{
-   // Fullscreen?
-   if (fullscreen) {
-      // Do it this way
-      SDL_DisplayMode currentMode;
-      SDL_GetCurrentDisplayMode(0, &currentMode);
-      currentMode.w = screenWidth;
-      currentMode.h = screenHeight;
-      SDL_SetWindowDisplayMode(window, &currentMode);
-   }
-   // Windowed?
-   else {
-      // Do it that way
-      SDL_SetWindowSize(window, screenWidth, screenHeight);
-   }
-}
-
-void SDLWindow::Present() {
-   SDL_RenderPresent(this->Renderer());
+#include "SDLWindow.h"
+#include "SDLContext.h"
+#include <cassert>
+#include <string>
+#include <map>
+#include <mutex>
+using std::string;
+using std::map;
+using std::mutex;
+using std::lock_guard;
+
+// Pending RedrawAfter timers. The timer callback gets a key rather than the window, and only
+// touches a window whose key is still here, so Shutdown can cancel them even if one is
+// already firing on SDL's timer thread.
+struct PendingRedraw {
+   SDLWindow* window;
+   SDL_TimerID timer;
+};
+static mutex redrawLock;
+static map<size_t, PendingRedraw> pendingRedraws;
+static size_t nextRedraw = 0;
+
+// Constructor
+SDLWindow::SDLWindow()
+{
+   screen = nullptr;
+   window = nullptr;
+   renderer = nullptr;
+   started = false;
+   ownsScreen = false;
+   logicalTarget = nullptr;
+   logicalWidth = logicalHeight = 0;
+   integerScale = true;
+   presentRect.x = presentRect.y = presentRect.w = presentRect.h = 0;
+   outputWidth = outputHeight = 0;
+   windowWidth = windowHeight = 0;
+   dirty = true;
+   dirtyCounter = 0;
+   frameWokeAt = 0;
+   wakeEventType = (Uint32)-1;
+   wakeLatency = maxWakeLatency = 0.0f;
+   totalWakeLatency = 0.0;
+   wakeCount = 0;
+   trackedInput = 0;
+}
+
+// Destructor
+SDLWindow::~SDLWindow()
+{
+   Shutdown();
+}
+
+// Gets an instance of the SDLWindow
+SDLWindow* SDLWindow::Instance()
+{
+   static SDLWindow myWindow;
+   return &myWindow;
+}
+
+// Initializes the window/video
+void SDLWindow::Init(const char* title, const int screenWidth, const int screenHeight,
+   const bool fullscreen, const bool vsync, const bool centerX, const bool centerY, const bool borderless,
+   const bool resizable)
+{
+   // Close anything already open
+   Shutdown();
+
+   // Initialize SDL Video
+   started = AcquireSDL(SDL_INIT_VIDEO);
+
+   // Setup screen settings
+   this->screenWidth = screenWidth;
+   this->screenHeight = screenHeight;
+   this->fullscreen = fullscreen;
+
+   // Set up display flags
+   Uint32 displayFlags = 0;
+   displayFlags |= (fullscreen ? SDL_WINDOW_FULLSCREEN : 0);
+   displayFlags |= (borderless ? SDL_WINDOW_BORDERLESS : 0);
+   displayFlags |= (resizable ? SDL_WINDOW_RESIZABLE : 0);
+
+   // Create the window
+   window = SDL_CreateWindow(title, //  Title of the window
+      (centerX ? SDL_WINDOWPOS_CENTERED : SDL_WINDOWPOS_UNDEFINED), // Centered on the X?
+      (centerY ? SDL_WINDOWPOS_CENTERED : SDL_WINDOWPOS_UNDEFINED), // Centered on the Y?
+      screenWidth, // Width of the screen
+      screenHeight, // Height of the screen
+      displayFlags); // All the flags set up earlier
+
+   // Create the Renderer
+   int renderVals = 0;
+   renderVals = renderVals | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0);
+   renderer = SDL_CreateRenderer(window, -1, renderVals);
+
+   // Get the screen
+   screen = SDL_GetWindowSurface(window);
+
+   // Event used to wake up an idle loop
+   wakeEventType = SDL_RegisterEvents(1);
+   dirty = true;
+
+   // Default the background color to black
+   SetBackgroundColor();
+}
+
+// Draws into a surface with the software renderer instead of opening a window
+void SDLWindow::InitOffscreen(const int width, const int height)
+{
+   // Close anything already open
+   Shutdown();
+
+   this->screenWidth = width;
+   this->screenHeight = height;
+   this->fullscreen = false;
+
+   // The surface is ours, the software renderer needs no video driver
+   screen = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+   assert(screen && "Failed to create the offscreen surface");
+   ownsScreen = true;
+   renderer = SDL_CreateSoftwareRenderer(screen);
+   assert(renderer && "Failed to create the offscreen renderer");
+
+   // Nothing to wake up, there's no event loop
+   wakeEventType = (Uint32)-1;
+   dirty = true;
+
+   // Default the background color to black
+   SetBackgroundColor();
+}
+
+void SDLWindow::Clear()
+{
+   // The frame starts here, anything marked dirty from now on needs another one
+   dirty = false;
+   frameWokeAt = dirtyCounter.exchange(0);
+
+   // Draw into the logical target if there is one
+   if (logicalTarget) {
+      SDL_SetRenderTarget(renderer, logicalTarget);
+   }
+
+   // Clear the screen
+   SDL_RenderClear(renderer);
+}
+
+void SDLWindow::SetBackgroundColor(const int red, const int green, const int blue)
+{
+   // Set the background color
+   if (screen && screen->format) {
+      bgColor = SDL_MapRGB(screen->format, red, green, blue);
+   }
+   SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
+}
+
+// Cleans up and shuts down
+void SDLWindow::Shutdown()
+{
+   // Background back to black
+   SetBackgroundColor();
+
+   // The logical target goes before its renderer
+   if (logicalTarget) {
+      SDL_DestroyTexture(logicalTarget);
+      logicalTarget = nullptr;
+   }
+
+   // Delete any existing renderer
+   if (renderer) {
+      SDL_DestroyRenderer(renderer);
+      renderer = nullptr;
+   }
+
+   // Delete an offscreen surface (a window's surface belongs to the window)
+   if (screen && ownsScreen) {
+      SDL_FreeSurface(screen);
+   }
+   screen = nullptr;
+   ownsScreen = false;
+
+   // Delete the window
+   if (window) {
+      SDL_DestroyWindow(window);
+      window = nullptr;
+   }
+
+   // Cancel any RedrawAfter still waiting, the timers would outlive us
+   {
+      lock_guard<mutex> guard(redrawLock);
+      for (map<size_t, PendingRedraw>::iterator it = pendingRedraws.begin(); it != pendingRedraws.end();) {
+         if (it->second.window == this) {
+            SDL_RemoveTimer(it->second.timer);
+            it = pendingRedraws.erase(it);
+         }
+         else {
+            ++it;
+         }
+      }
+   }
+
+   // Shutdown the video (and SDL, once no other window or context needs it)
+   if (started) {
+      ReleaseSDL(SDL_INIT_VIDEO);
+      started = false;
+   }
+}
+
+// Sets the fullscreen mode
+void SDLWindow::Fullscreen(const bool fullscreen)
+{
+   // Offscreen surfaces have no screen to fill
+   if (!window) {
+      return;
+   }
+   this->fullscreen = fullscreen;
+   SDL_SetWindowFullscreen(window, (fullscreen ? SDL_WINDOW_FULLSCREEN : 0));
+}
+
+// Changes the screen resolution
+void SDLWindow::Resolution(const int screenWidth, const int screenHeight)
+{
+   // Offscreen surfaces keep the size they were made with
+   if (!window) {
+      return;
+   }
+
+   this->screenWidth = screenWidth;
+   this->screenHeight = screenHeight;
+
+   // Fullscreen?
+   if (fullscreen) {
+      // Do it this way
+      SDL_DisplayMode currentMode;
+      SDL_GetCurrentDisplayMode(0, &currentMode);
+      currentMode.w = screenWidth;
+      currentMode.h = screenHeight;
+      SDL_SetWindowDisplayMode(window, &currentMode);
+   }
+   // Windowed?
+   else {
+      // Do it that way
+      SDL_SetWindowSize(window, screenWidth, screenHeight);
+   }
+}
+
+// Draws everything at a fixed size and scales it up to the window
+void SDLWindow::LogicalResolution(const int logicalWidth, const int logicalHeight, const bool integerScale)
+{
+   // Get rid of any old target
+   if (logicalTarget) {
+      SDL_SetRenderTarget(renderer, nullptr);
+      SDL_DestroyTexture(logicalTarget);
+      logicalTarget = nullptr;
+   }
+
+   this->logicalWidth = logicalWidth;
+   this->logicalHeight = logicalHeight;
+   this->integerScale = integerScale;
+
+   // 0x0 means draw straight to the window again
+   if (logicalWidth <= 0 || logicalHeight <= 0) {
+      return;
+   }
+
+   // Integer scaling should stay crisp, fractional scaling should be filtered.
+   // The hint is only read when a texture is created, so put it back afterwards.
+   const char* oldQuality = SDL_GetHint(SDL_HINT_RENDER_SCALE_QUALITY);
+   string previousQuality = (oldQuality ? oldQuality : "nearest");
+   SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, (integerScale ? "nearest" : "linear"));
+   logicalTarget = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+      logicalWidth, logicalHeight);
+   SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, previousQuality.c_str());
+   assert(logicalTarget && "Failed to create the logical resolution target");
+
+   // Force the presentation rect to be recalculated (nothing's been drawn into the target yet,
+   // so the window is still the render target)
+   outputWidth = outputHeight = 0;
+   UpdatePresentRect();
+
+   // Everything drawn from now on goes to the target
+   SDL_SetRenderTarget(renderer, logicalTarget);
+}
+
+// Recomputes where the logical target goes, only when the window size changed.
+// The window has to be the render target, or the output size is the target's.
+void SDLWindow::UpdatePresentRect()
+{
+   int newWidth = 0;
+   int newHeight = 0;
+   SDL_GetRendererOutputSize(renderer, &newWidth, &newHeight);
+   if (newWidth == outputWidth && newHeight == outputHeight) {
+      return;
+   }
+   outputWidth = newWidth;
+   outputHeight = newHeight;
+   if (window) {
+      SDL_GetWindowSize(window, &windowWidth, &windowHeight);
+   }
+   else {
+      windowWidth = outputWidth;
+      windowHeight = outputHeight;
+   }
+
+   // Biggest scale that fits
+   float scaleX = (float)outputWidth / logicalWidth;
+   float scaleY = (float)outputHeight / logicalHeight;
+   float scale = (scaleX < scaleY ? scaleX : scaleY);
+
+   // Snap to whole pixels (unless the window is smaller than the logical size)
+   if (integerScale && scale >= 1.0f) {
+      scale = (float)(int)scale;
+   }
+
+   presentRect.w = (int)(logicalWidth * scale);
+   presentRect.h = (int)(logicalHeight * scale);
+   presentRect.x = (outputWidth - presentRect.w) >> 1;
+   presentRect.y = (outputHeight - presentRect.h) >> 1;
+}
+
+// Converts a point in window coordinates into logical coordinates
+void SDLWindow::WindowToLogical(int& x, int& y) const
+{
+   // Nothing to do without a target
+   if (!logicalTarget || presentRect.w <= 0 || presentRect.h <= 0 || windowWidth <= 0 || windowHeight <= 0) {
+      return;
+   }
+
+   // Window coordinates to output pixels (they differ on high DPI displays)
+   int outputX = x * outputWidth / windowWidth;
+   int outputY = y * outputHeight / windowHeight;
+
+   // Output pixels to logical pixels
+   x = (outputX - presentRect.x) * logicalWidth / presentRect.w;
+   y = (outputY - presentRect.y) * logicalHeight / presentRect.h;
+}
+
+void SDLWindow::Present() {
+   // Scale the logical target up to the window
+   if (logicalTarget) {
+      // Back to the window first, the output size is the target's while it's set
+      SDL_SetRenderTarget(renderer, nullptr);
+      UpdatePresentRect();
+      SDL_RenderClear(renderer);
+      SDL_RenderCopy(renderer, logicalTarget, nullptr, &presentRect);
+      SDL_RenderPresent(renderer);
+      SDL_SetRenderTarget(renderer, logicalTarget);
+   }
+   else {
+      SDL_RenderPresent(this->Renderer());
+   }
+
+   // Did this frame show any input someone asked about?
+   if (trackedInput != 0) {
+      inputLatency.Add((float)((SDL_GetPerformanceCounter() - trackedInput) * 1000.0 / SDL_GetPerformanceFrequency()));
+      trackedInput = 0;
+   }
+
+   // How long since we were woken up (for this frame)?
+   Uint64 wokeAt = frameWokeAt;
+   frameWokeAt = 0;
+   if (wokeAt != 0) {
+      wakeLatency = (float)((SDL_GetPerformanceCounter() - wokeAt) * 1000.0 / SDL_GetPerformanceFrequency());
+      if (wakeLatency > maxWakeLatency) {
+         maxWakeLatency = wakeLatency;
+      }
+      totalWakeLatency += wakeLatency;
+      ++wakeCount;
+   }
+}
+
+// Says the screen needs to be redrawn
+void SDLWindow::MarkDirty(const bool wakeUp)
+{
+   // Only the first mark since the frame started matters
+   Uint64 expected = 0;
+   dirtyCounter.compare_exchange_strong(expected, SDL_GetPerformanceCounter());
+   if (dirty.exchange(true)) {
+      return;
+   }
+
+   // Wake up anyone sleeping in SDLInput::WaitUpdate
+   if (wakeUp && wakeEventType != (Uint32)-1) {
+      SDL_Event wakeEvent;
+      SDL_memset(&wakeEvent, 0, sizeof(wakeEvent));
+      wakeEvent.type = wakeEventType;
+      SDL_PushEvent(&wakeEvent);
+   }
+}
+
+// Calls MarkDirty after a delay
+void SDLWindow::RedrawAfter(const Uint32 milliseconds)
+{
+   lock_guard<mutex> guard(redrawLock);
+   size_t key = ++nextRedraw;
+   SDL_TimerID timer = SDL_AddTimer(milliseconds, &SDLWindow::RedrawTimer, (void*)key);
+   if (timer != 0) {
+      PendingRedraw redraw;
+      redraw.window = this;
+      redraw.timer = timer;
+      pendingRedraws[key] = redraw;
+   }
+}
+
+// Timer callback for RedrawAfter (runs on SDL's timer thread)
+Uint32 SDLWindow::RedrawTimer(Uint32 interval, void* param)
+{
+   // Only if the window hasn't cancelled it (or gone away) in the meantime
+   lock_guard<mutex> guard(redrawLock);
+   map<size_t, PendingRedraw>::iterator found = pendingRedraws.find((size_t)param);
+   if (found != pendingRedraws.end()) {
+      SDLWindow* window = found->second.window;
+      pendingRedraws.erase(found);
+      window->MarkDirty();
+   }
+
+   // One shot
+   return 0;
+}
+
+// Says the input that happened at this performance counter affects this frame
+void SDLWindow::TrackInput(const Uint64 inputCounter)
+{
+   // Keep the oldest one
+   if (trackedInput == 0 || inputCounter < trackedInput) {
+      trackedInput = inputCounter;
+   }
+}
+
+// Forgets everything
+void LatencyHistogram::Reset()
+{
+   for (int ii = 0; ii < LATENCYBUCKETS; ++ii) {
+      buckets[ii] = 0;
+   }
+   count = 0;
+   lowest = highest = 0.0f;
+   total = 0.0;
+}
+
+// Adds a measurement
+void LatencyHistogram::Add(const float milliseconds)
+{
+   int bucket = (int)milliseconds;
+   if (bucket < 0) {
+      bucket = 0;
+   }
+   if (bucket >= LATENCYBUCKETS) {
+      bucket = LATENCYBUCKETS - 1;
+   }
+   buckets[bucket]++;
+
+   if (count == 0 || milliseconds < lowest) {
+      lowest = milliseconds;
+   }
+   if (count == 0 || milliseconds > highest) {
+      highest = milliseconds;
+   }
+   total += milliseconds;
+   ++count;
+}
+
+// Upper edge of the bucket the percentile falls in
+float LatencyHistogram::Percentile(const float percent) const
+{
+   if (count == 0) {
+      return 0.0f;
+   }
+   int wanted = (int)(count * percent / 100.0f);
+   int seen = 0;
+   for (int ii = 0; ii < LATENCYBUCKETS - 1; ++ii) {
+      seen += buckets[ii];
+      if (seen > wanted) {
+         return (float)(ii + 1);
+      }
+   }
+   return highest;
 }
\ No newline at end of file
@@ -1,66 +1,176 @@
-#ifndef SDLWINDOW_H_
-#define SDLWINDOW_H_
-
-// Includes
-#include <SDL.h> // Mostly for the Uint32
-
-class SDLWindow {
-private:
-   // Members
-   int screenWidth;
-   int screenHeight;
-   bool fullscreen;
-   Uint32 bgColor;
-   SDL_Window* window;
-   SDL_Surface* screen;
-   SDL_Renderer* renderer;
-
-   // Constructor
-   SDLWindow();
-
-   // Copy Constructor
-   SDLWindow(const SDLWindow& rhs) {};
-
-   // Assignment Operator
-   SDLWindow& operator=(const SDLWindow& rhs) { return *this; };
-
-public:
-   // Destructor
-   ~SDLWindow();
-
-   // Singleton
-   static SDLWindow* Instance();
-
-   // Initializes the window/video
-   void Init(const char* title = "My Window", const int screenWidth = 640, const int screenHeight = 480,
-      const bool fullscreen = false, const bool vsync = false, const bool centerX = false, const bool centerY = false, 
-      const bool borderless = false, const bool resizable = false);
-
-   // Clears the screen (done every frame)
-   void Clear();
-
-   // Set the background color (defaults to black)
-   void SetBackgroundColor(const int red = 0, const int green = 0, const int blue = 0);
-
-   // Cleans up and shuts down the video
-   void Shutdown();
-
-   // Changes the resolution
-   void Resolution(const int screenWidth, const int screenHeight);
-
-   // Sets Fullscreen Mode
-   void Fullscreen(const bool fullscreen = false);
-
-   // Renders the screen. Called every frame
-   void Present();
-
-   // Accessors/Mutators
-   int ScreenWidth() const { return screenWidth; }
-   int ScreenHeight() const { return screenHeight; }
-   bool Fullscreen() const { return fullscreen; }
-   SDL_Window* Window() { return window; }
-   SDL_Renderer* Renderer() { return renderer; }
-   SDL_Surface* Screen() { return screen; }
-};
-
+#ifndef SDLWINDOW_H_
+#define SDLWINDOW_H_
+
+// Includes
+#include <SDL.h> // Mostly for the Uint32
+#include <atomic>
+
+// Defines
+#define LATENCYBUCKETS 64
+
+// Counts how many frames took how long, in 1 millisecond buckets (the last one catches everything slower)
+struct LatencyHistogram {
+   int buckets[LATENCYBUCKETS];
+   int count;
+   float lowest;
+   float highest;
+   double total;
+
+   LatencyHistogram() { Reset(); }
+
+   // Forgets everything
+   void Reset();
+
+   // Adds a measurement
+   void Add(const float milliseconds);
+
+   // Average of every measurement
+   float Average() const { return (count > 0 ? (float)(total / count) : 0.0f); }
+
+   // Upper edge of the bucket the percentile (0-100) falls in
+   float Percentile(const float percent) const;
+};
+
+class SDLWindow {
+private:
+   // Members
+   int screenWidth;
+   int screenHeight;
+   bool fullscreen;
+   Uint32 bgColor;
+   SDL_Window* window;
+   SDL_Surface* screen;
+   SDL_Renderer* renderer;
+
+   // Whether Init started the video (offscreen windows don't need it), and whether the
+   // screen is our own surface rather than the window's
+   bool started;
+   bool ownsScreen;
+
+   // Logical resolution (everything is drawn here, then scaled to the window)
+   SDL_Texture* logicalTarget;
+   int logicalWidth;
+   int logicalHeight;
+   bool integerScale;
+
+   // Where the logical target lands on the window, cached until the output size changes
+   SDL_Rect presentRect;
+   int outputWidth;
+   int outputHeight;
+   int windowWidth;
+   int windowHeight;
+
+   // Recomputes the presentation rect if the window size changed
+   void UpdatePresentRect();
+
+   // Idle rendering. Set when something needs drawing, cleared when Clear starts the frame that
+   // draws it (so a MarkDirty that lands while the frame is being drawn asks for another one).
+   std::atomic<bool> dirty;
+   std::atomic<Uint64> dirtyCounter;
+   Uint64 frameWokeAt;
+   Uint32 wakeEventType;
+
+   // How long it took from MarkDirty to the end of Present (milliseconds)
+   float wakeLatency;
+   float maxWakeLatency;
+   double totalWakeLatency;
+   int wakeCount;
+
+   // Input to present latency, and the oldest input waiting to be shown
+   LatencyHistogram inputLatency;
+   Uint64 trackedInput;
+
+   // Timer callback for RedrawAfter
+   static Uint32 RedrawTimer(Uint32 interval, void* param);
+
+   // Copy Constructor
+   SDLWindow(const SDLWindow& rhs) {};
+
+   // Assignment Operator
+   SDLWindow& operator=(const SDLWindow& rhs) { return *this; };
+
+public:
+   // Constructor. Instance() is the default window the macros use; make more of these
+   // (or SDLContexts) when one isn't enough.
+   SDLWindow();
+
+   // Destructor
+   ~SDLWindow();
+
+   // Singleton
+   static SDLWindow* Instance();
+
+   // Initializes the window/video
+   void Init(const char* title = "My Window", const int screenWidth = 640, const int screenHeight = 480,
+      const bool fullscreen = false, const bool vsync = false, const bool centerX = false, const bool centerY = false, 
+      const bool borderless = false, const bool resizable = false);
+
+   // Draws into a surface with the software renderer instead of opening a window. Nothing is
+   // shown; read the result out of Screen(). Safe to use on a thread of its own.
+   void InitOffscreen(const int width, const int height);
+
+   // Clears the screen and starts the frame (done every frame)
+   void Clear();
+
+   // Set the background color (defaults to black)
+   void SetBackgroundColor(const int red = 0, const int green = 0, const int blue = 0);
+
+   // Cleans up and shuts down the video
+   void Shutdown();
+
+   // Changes the resolution
+   void Resolution(const int screenWidth, const int screenHeight);
+
+   // Draws everything at a fixed size and scales it to the window in Present.
+   // Integer scaling keeps pixels square, otherwise the image is aspect-fit. 0x0 turns it off.
+   void LogicalResolution(const int logicalWidth, const int logicalHeight, const bool integerScale = true);
+
+   // Converts a point in window coordinates into logical coordinates
+   void WindowToLogical(int& x, int& y) const;
+
+   // Sets Fullscreen Mode
+   void Fullscreen(const bool fullscreen = false);
+
+   // Renders the screen. Called every frame
+   void Present();
+
+   // Says the screen needs to be redrawn. Wakes up SDLInput::WaitUpdate, safe from any thread.
+   void MarkDirty(const bool wakeUp = true);
+
+   // Calls MarkDirty after a delay (for animations and blinking cursors while idle).
+   // Shutdown cancels any that haven't fired.
+   void RedrawAfter(const Uint32 milliseconds);
+
+   // Returns true if something changed since the last frame started (see Clear)
+   bool NeedsRedraw() const { return dirty.load(); }
+
+   // The event MarkDirty pushes to wake up the event loop
+   Uint32 WakeEventType() const { return wakeEventType; }
+
+   // Says the input that happened at this performance counter (TimedEvent::origin) affects
+   // this frame, so the next Present adds how long it took to the input latency histogram
+   void TrackInput(const Uint64 inputCounter);
+
+   // How long tracked inputs took to reach the screen
+   const LatencyHistogram& InputLatency() const { return inputLatency; }
+   void ResetInputLatency() { inputLatency.Reset(); }
+
+   // Time from the first MarkDirty (or input event) to the end of Present, in milliseconds
+   float WakeLatency() const { return wakeLatency; }
+   float MaxWakeLatency() const { return maxWakeLatency; }
+   float AverageWakeLatency() const { return (wakeCount > 0 ? (float)(totalWakeLatency / wakeCount) : 0.0f); }
+
+   // Accessors/Mutators
+   int ScreenWidth() const { return screenWidth; }
+   int ScreenHeight() const { return screenHeight; }
+   bool Fullscreen() const { return fullscreen; }
+   bool LogicalResolution() const { return logicalTarget != nullptr; }
+   bool Offscreen() const { return window == nullptr && renderer != nullptr; }
+   int RenderWidth() const { return (logicalTarget ? logicalWidth : screenWidth); }
+   int RenderHeight() const { return (logicalTarget ? logicalHeight : screenHeight); }
+   SDL_Window* Window() { return window; }
+   SDL_Renderer* Renderer() { return renderer; }
+   SDL_Surface* Screen() { return screen; }
+};
+
 #endif // SDLWINDOW_H_
\ No newline at end of file
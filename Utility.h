@@ -1,19 +1,20 @@
-#ifndef UTILITY_H_
-#define UTILITY_H_
-
-#include "SDLWindow.h"
-#include "SDLTexture.h"
-#include "SDLInput.h"
-#include "SDLAudio.h"
-
-#define win SDLWindow::Instance()
-#define tex SDLTexture::Instance()
-#define input SDLInput::Instance()
-#define audio SDLAudio::Instance()
-
-#define HALFWIDTH(imageId) (SDLTexture::Instance()->ImageWidth(imageId) >> 1)
-#define HALFHEIGHT(imageId) (SDLTexture::Instance()->ImageHeight(imageId) >> 1)
-#define CENTERX (SDLWindow::Instance()->ScreenWidth() >> 1)
-#define CENTERY (SDLWindow::Instance()->ScreenHeight() >> 1)
-
+#ifndef UTILITY_H_
+#define UTILITY_H_
+
+#include "SDLWindow.h"
+#include "SDLTexture.h"
+#include "SDLInput.h"
+#include "SDLAudio.h"
+#include "SDLLoop.h"
+
+#define win SDLWindow::Instance()
+#define tex SDLTexture::Instance()
+#define input SDLInput::Instance()
+#define audio SDLAudio::Instance()
+
+#define HALFWIDTH(imageId) (SDLTexture::Instance()->ImageWidth(imageId) >> 1)
+#define HALFHEIGHT(imageId) (SDLTexture::Instance()->ImageHeight(imageId) >> 1)
+#define CENTERX (SDLWindow::Instance()->RenderWidth() >> 1)
+#define CENTERY (SDLWindow::Instance()->RenderHeight() >> 1)
+
 #endif // UTILITY_H_
\ No newline at end of file